@@ -0,0 +1,1847 @@
+/************************************************************************/
+/**
+
+   Program:
+   \file       AsyncIO.c
+
+   \version    V1.2
+   \date       18.10.26
+   \brief      Asynchronous whole-file reads and atomic writes for batch
+               runs
+
+   \copyright  (c) agent 2026
+   \author     agent
+   \par
+               agent@local
+
+**************************************************************************
+
+   This program is not in the public domain, but it may be copied
+   according to the conditions laid out in the accompanying file
+   COPYING.DOC
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified.
+
+   The code may not be sold commercially or included as part of a
+   commercial product except as described in the file COPYING.DOC.
+
+**************************************************************************
+
+   Description:
+   ============
+   An I/O engine which reads whole input files into memory ahead of
+   their being needed and writes whole output files atomically (to a
+   temporary file which is synced, closed and renamed over the output
+   file).
+
+   On Linux the engine uses io_uring, driven directly through the
+   system calls so that liburing is not needed. Each read is queued as
+   an OPENAT and a STATX (for the size) of the file, then a READ once
+   both have completed and a CLOSE once the caller has the data. Each
+   write is queued as an OPENAT of the temporary file, then a linked
+   WRITE, FSYNC and CLOSE, then a RENAMEAT over the output file.
+   Nothing is submitted to the kernel until we need to wait for a read
+   or a free slot, so the operations for several files go in a single
+   io_uring_enter() call and the kernel works on the reads ahead and
+   the writes behind while the caller processes the current file.
+
+   The caller's thread still makes a few blocking calls itself: the
+   rename() if the kernel is too old for RENAMEAT (before 5.11), the
+   pwrite()s to finish a write that was cut short, the unlink() of the
+   temporary file after a failed write, and the directory sync by
+   SyncDirectory() or SyncFileDirectory(). The io_uring engine needs
+   headers from Linux 5.11 or later and a kernel which supports all
+   the other operations listed above; otherwise the fallback is used.
+
+   If io_uring is not available (older kernels, other systems, or
+   blocked by a seccomp filter) or the code is compiled with
+   -DAIO_NO_URING, the engine falls back to a small pool of threads
+   which do the same work with blocking calls: each read is handed to
+   a thread when it is submitted, so files are still read ahead, and
+   each write (to the temporary file, then fsync(), close() and
+   rename()) is done by a thread behind the caller. Threads take reads
+   before writes so that the file the caller needs next is not held up
+   behind a queue of fsync() calls. If no thread can be started, reads
+   are done in AIOWaitRead() and writes in AIOSubmitWrite().
+
+   A read is started with AIOSubmitRead(), which returns a ticket, and
+   collected with AIOWaitRead(). A write is started with
+   AIOSubmitWrite(), which takes over the data buffer, and
+   AIOFlushWrites() waits for all writes to finish.
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0    18.10.26   Original   By: agent
+   V1.1    18.10.26   The fallback uses a thread pool for read-ahead and
+                      write-behind. AIOUsingRing() replaced by
+                      AIOEngineName()
+                      By: agent
+   V1.2    18.10.26   Files are opened, sized and renamed on the ring
+                      rather than in the caller's thread
+                      By: agent
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#if defined(__linux__) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    define AIO_HAVE_URING 1
+#  endif
+#endif
+#ifdef AIO_NO_URING
+#  undef AIO_HAVE_URING
+#endif
+
+#ifdef AIO_HAVE_URING
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <linux/stat.h>
+#  include <linux/io_uring.h>
+   /* RENAMEAT and this flag both arrived in the 5.11 headers           */
+#  ifndef IORING_FEAT_SQPOLL_NONFIXED
+#    undef AIO_HAVE_URING
+#  endif
+#endif
+
+#include "bioplib/SysDefs.h"
+#include "bioplib/macros.h"
+#include "AsyncIO.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define MAXBUFF      160
+#define AIO_OP_READ   0
+#define AIO_OP_WRITE  1
+#define AIO_OP_FSYNC  2
+#define AIO_OP_CLOSE  3
+#define AIO_OP_OPEN   4
+#define AIO_OP_STATX  5
+#define AIO_OP_RENAME 6
+#define AIO_MAXIO    (1 << 30)     /* Largest single read or write      */
+#define AIO_NTHREADS 4             /* Threads in the fallback pool      */
+
+/* Each operation submitted carries the job slot and the operation     */
+#define USERDATA(slot, op)  ((((uint64_t)(slot)) << 3) | (op))
+#define UD_SLOT(ud)         ((int)((ud) >> 3))
+#define UD_OP(ud)           ((int)((ud) & 7))
+
+/************************************************************************/
+/* Type definitions
+*/
+typedef struct
+{
+   char   *filename,
+          *tmpfile,
+          *data;
+   size_t size,
+          done;
+   int    fd,
+          nPending,
+          error;
+   BOOL   inUse,
+          complete,
+          synced,
+          closed;
+#ifdef AIO_HAVE_URING
+   struct statx statxBuf;        /* Filled in by a STATX on the ring    */
+#endif
+}  AIOJOB;
+
+/* A FIFO of job slots waiting for a pool thread                       */
+typedef struct
+{
+   int    *slots,
+          size,
+          head,
+          count;
+}  AIOQUEUE;
+
+struct _aioengine
+{
+   AIOJOB   *jobs;               /* Reads then writes                   */
+   int      nReads,
+            nWrites,
+            nFailed;
+   BOOL     useRing,
+            usePool;
+   /* Fallback thread pool. The lock protects the queues, stopping and
+      the complete flag of jobs given to the pool
+   */
+   pthread_t       *threads;
+   int             nThreads;
+   AIOQUEUE        readQueue,
+                   writeQueue;
+   pthread_mutex_t lock;
+   pthread_cond_t  workCond,     /* Work queued or the pool stopping    */
+                   doneCond;     /* A pool job has completed            */
+   BOOL            stopping;
+#ifdef AIO_HAVE_URING
+   int      ringfd;
+   BOOL     ringRename;          /* Does the kernel have RENAMEAT?      */
+   unsigned *sqHead, *sqTail, *sqMask, *sqArray,
+            *cqHead, *cqTail, *cqMask,
+            sqEntries, cqEntries,
+            toSubmit,            /* Queued but not given to the kernel  */
+            inFlight;            /* Queued or submitted but not reaped  */
+   struct io_uring_sqe *sqes;
+   struct io_uring_cqe *cqes;
+   void     *sqRing, *cqRing;
+   size_t   sqRingSize, cqRingSize, sqesSize;
+#endif
+};
+
+/************************************************************************/
+/* Prototypes
+*/
+static BOOL ReadWholeFile(char *filename, char **data, size_t *size);
+static void ClearJob(AIOJOB *job);
+static BOOL StartJob(AIOJOB *job, char *filename, BOOL isWrite);
+static int  WriteTmpFile(char *outfile, char *tmpfile, char *data,
+                         size_t size);
+static BOOL StartPool(AIOENGINE *aio);
+static void StopPool(AIOENGINE *aio);
+static void *PoolWorker(void *arg);
+static void QueueJob(AIOENGINE *aio, int slot);
+static void WaitJob(AIOENGINE *aio, AIOJOB *job);
+static BOOL PoolWrite(AIOENGINE *aio, char *outfile, char *data,
+                      size_t size);
+static void FinishPoolWrite(AIOENGINE *aio, AIOJOB *job);
+#ifdef AIO_HAVE_URING
+static BOOL SetupRing(AIOENGINE *aio, int entries);
+static BOOL ProbeRing(AIOENGINE *aio);
+static void FreeRing(AIOENGINE *aio);
+static void QueueOp(AIOENGINE *aio, int op, int fd, void *addr,
+                    size_t len, uint64_t offset, uint64_t userData,
+                    unsigned flags, unsigned opFlags);
+static BOOL QueueWrite(AIOENGINE *aio, char *outfile, char *data,
+                       size_t size);
+static void MakeRoom(AIOENGINE *aio, unsigned nOps);
+static void Reap(AIOENGINE *aio, BOOL wait);
+static void HandleCompletion(AIOENGINE *aio, uint64_t userData, int res);
+static void HandleReadCompletion(AIOENGINE *aio, int slot, int op,
+                                 int res);
+static void StartRead(AIOENGINE *aio, int slot);
+static void QueueWriteOps(AIOENGINE *aio, int slot);
+static void RenameWrite(AIOENGINE *aio, int slot);
+static void FinishWrite(AIOENGINE *aio, AIOJOB *job);
+#endif
+
+/************************************************************************/
+/*>AIOENGINE *CreateAIOEngine(int nReads, int nWrites)
+   ---------------------------------------------------
+*//**
+
+   \param[in]      nReads       Maximum number of reads in progress
+   \param[in]      nWrites      Maximum number of writes in progress
+   \return                      I/O engine (NULL if out of memory)
+
+   Creates an I/O engine, using io_uring if we can, a thread pool if
+   not and blocking I/O in the caller's thread if threads cannot be
+   started
+
+-  18.10.26 Original
+-  18.10.26 Starts the thread pool if io_uring is not used   By: agent
+*/
+AIOENGINE *CreateAIOEngine(int nReads, int nWrites)
+{
+   AIOENGINE *aio;
+   int       i;
+
+   if((aio = (AIOENGINE *)malloc(sizeof(AIOENGINE))) == NULL)
+      return(NULL);
+   if((aio->jobs = (AIOJOB *)malloc((nReads + nWrites) * sizeof(AIOJOB)))
+      == NULL)
+   {
+      free(aio);
+      return(NULL);
+   }
+   for(i=0; i<nReads+nWrites; i++)
+      ClearJob(&(aio->jobs[i]));
+
+   aio->nReads  = nReads;
+   aio->nWrites = nWrites;
+   aio->nFailed = 0;
+   aio->useRing = FALSE;
+   aio->usePool = FALSE;
+
+#ifdef AIO_HAVE_URING
+   /* Reads and writes each have up to 3 operations in flight at once  */
+   aio->useRing = SetupRing(aio, 3*(nReads + nWrites));
+#endif
+   if(!aio->useRing)
+      aio->usePool = StartPool(aio);
+
+   return(aio);
+}
+
+
+/************************************************************************/
+/*>void FreeAIOEngine(AIOENGINE *aio)
+   ----------------------------------
+*//**
+
+   \param[in]      *aio         I/O engine
+
+   Finishes any outstanding writes, waits for any outstanding reads and
+   frees the engine
+
+-  18.10.26 Original
+-  18.10.26 Stops the thread pool   By: agent
+*/
+void FreeAIOEngine(AIOENGINE *aio)
+{
+   int i;
+
+   AIOFlushWrites(aio);
+
+   if(aio->usePool)
+   {
+      for(i=0; i<aio->nReads; i++)
+      {
+         if(aio->jobs[i].inUse)
+            WaitJob(aio, &(aio->jobs[i]));
+      }
+      StopPool(aio);
+   }
+
+#ifdef AIO_HAVE_URING
+   if(aio->useRing)
+   {
+      /* The kernel may still be reading into our buffers              */
+      while(aio->inFlight)
+         Reap(aio, TRUE);
+      FreeRing(aio);
+   }
+#endif
+
+   for(i=0; i<aio->nReads; i++)
+   {
+      AIOJOB *job = &(aio->jobs[i]);
+      if(job->inUse)
+      {
+         if(!job->closed && (job->fd >= 0))
+            close(job->fd);
+         FREE(job->data);
+         FREE(job->filename);
+      }
+   }
+   free(aio->jobs);
+   free(aio);
+}
+
+
+/************************************************************************/
+/*>char *AIOEngineName(AIOENGINE *aio)
+   ------------------------------------
+*//**
+
+   \param[in]      *aio         I/O engine
+   \return                      How the engine does its I/O:
+                                "io_uring", "thread-pool" or "blocking"
+
+-  18.10.26 Original - replaces AIOUsingRing()   By: agent
+*/
+char *AIOEngineName(AIOENGINE *aio)
+{
+   if(aio->useRing)
+      return("io_uring");
+   if(aio->usePool)
+      return("thread-pool");
+   return("blocking");
+}
+
+
+/************************************************************************/
+/*>int AIOSubmitRead(AIOENGINE *aio, char *filename)
+   -------------------------------------------------
+*//**
+
+   \param[in]      *aio         I/O engine
+   \param[in]      *filename    File to read
+   \return                      Ticket for AIOWaitRead() (-1 if too many
+                                reads are in progress)
+
+   Starts reading a whole file into memory. Errors are reported by
+   AIOWaitRead().
+
+-  18.10.26 Original
+-  18.10.26 Hands the read to the thread pool if there is one. Frees
+            the slot if it cannot be started   By: agent
+-  18.10.26 Opens and sizes the file on the ring   By: agent
+*/
+int AIOSubmitRead(AIOENGINE *aio, char *filename)
+{
+   AIOJOB *job = NULL;
+   int    slot;
+
+   for(slot=0; slot<aio->nReads; slot++)
+   {
+      if(!aio->jobs[slot].inUse)
+      {
+         job = &(aio->jobs[slot]);
+         break;
+      }
+   }
+   if(job == NULL)
+      return(-1);
+   if(!StartJob(job, filename, FALSE))
+   {
+      FREE(job->filename);
+      ClearJob(job);
+      return(-1);
+   }
+
+   if(aio->usePool)
+   {
+      QueueJob(aio, slot);
+      return(slot);
+   }
+
+   /* Without io_uring or threads the file is simply read in 
+      AIOWaitRead()
+   */
+   if(!aio->useRing)
+      return(slot);
+
+#ifdef AIO_HAVE_URING
+   /* The READ is queued by StartRead() once we have the descriptor and
+      the size. The filename stays allocated until the job is complete
+   */
+   MakeRoom(aio, 2);
+   QueueOp(aio, AIO_OP_OPEN, AT_FDCWD, job->filename, 0, 0,
+           USERDATA(slot, AIO_OP_OPEN), 0, O_RDONLY);
+   QueueOp(aio, AIO_OP_STATX, AT_FDCWD, job->filename, STATX_SIZE,
+           (uint64_t)(uintptr_t)&(job->statxBuf),
+           USERDATA(slot, AIO_OP_STATX), 0, 0);
+   job->nPending = 2;
+#endif
+
+   return(slot);
+}
+
+
+/************************************************************************/
+/*>BOOL AIOWaitRead(AIOENGINE *aio, int ticket, char **data,
+                    size_t *size)
+   ----------------------------------------------------------
+*//**
+
+   \param[in]      *aio         I/O engine
+   \param[in]      ticket       Ticket from AIOSubmitRead()
+   \param[out]     **data       File contents, terminated by a '\0'.
+                                The caller must free() this
+   \param[out]     *size        Size of the file
+   \return                      Success? (errno is set on failure)
+
+   Waits for a read to finish. Any queued operations are first passed
+   to the kernel so that reads ahead and writes behind proceed while
+   the caller works on this file.
+
+-  18.10.26 Original
+-  18.10.26 Waits for the thread pool   By: agent
+*/
+BOOL AIOWaitRead(AIOENGINE *aio, int ticket, char **data, size_t *size)
+{
+   AIOJOB *job;
+   BOOL   ok;
+
+   *data = NULL;
+   *size = 0;
+   if((ticket < 0) || (ticket >= aio->nReads) ||
+      !aio->jobs[ticket].inUse)
+   {
+      errno = EINVAL;
+      return(FALSE);
+   }
+   job = &(aio->jobs[ticket]);
+
+   if(aio->useRing || aio->usePool)
+   {
+      if(aio->usePool)
+         WaitJob(aio, job);
+#ifdef AIO_HAVE_URING
+      if(aio->useRing)
+      {
+         Reap(aio, FALSE);
+         while(!job->complete)
+            Reap(aio, TRUE);
+
+         /* Close the file in the background                           */
+         if(job->fd >= 0)
+         {
+            MakeRoom(aio, 1);
+            QueueOp(aio, AIO_OP_CLOSE, job->fd, NULL, 0, 0,
+                    USERDATA(ticket, AIO_OP_CLOSE), 0, 0);
+         }
+      }
+#endif
+      ok = (job->error == 0);
+      if(ok)
+      {
+         job->data[job->done] = '\0';
+         *data     = job->data;
+         *size     = job->done;
+         job->data = NULL;
+      }
+      else
+      {
+         errno = job->error;
+      }
+   }
+   else
+   {
+      ok = ReadWholeFile(job->filename, data, size);
+   }
+
+   job->closed = TRUE;
+   FREE(job->data);
+   FREE(job->filename);
+   ClearJob(job);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>BOOL AIOSubmitWrite(AIOENGINE *aio, char *outfile, char *data,
+                       size_t size)
+   --------------------------------------------------------------
+*//**
+
+   \param[in]      *aio         I/O engine
+   \param[in]      *outfile     File to write
+   \param[in]      *data        Data to write. The engine frees this
+   \param[in]      size         Size of the data
+   \return                      Success so far? (Errors found later are
+                                counted by AIOFlushWrites())
+
+   Starts writing a file atomically. The data are written to outfile.tmp
+   which is synced, closed and renamed to outfile. If all the write
+   slots are busy, waits for one to finish.
+
+-  18.10.26 Original
+-  18.10.26 Hands the write to the thread pool if there is one
+            By: agent
+*/
+BOOL AIOSubmitWrite(AIOENGINE *aio, char *outfile, char *data,
+                    size_t size)
+{
+   if(aio->usePool)
+      return(PoolWrite(aio, outfile, data, size));
+
+   if(!aio->useRing)
+   {
+      BOOL ok = WriteFileAtomic(outfile, data, size);
+      free(data);
+      if(!ok)
+         aio->nFailed++;
+      return(ok);
+   }
+
+#ifdef AIO_HAVE_URING
+   return(QueueWrite(aio, outfile, data, size));
+#else
+   return(FALSE);
+#endif
+}
+
+
+/************************************************************************/
+/*>int AIOFlushWrites(AIOENGINE *aio)
+   ----------------------------------
+*//**
+
+   \param[in]      *aio         I/O engine
+   \return                      Number of writes which have failed since
+                                the last call
+
+   Waits for all writes in progress to finish
+
+-  18.10.26 Original
+-  18.10.26 Waits for the thread pool   By: agent
+*/
+int AIOFlushWrites(AIOENGINE *aio)
+{
+   int nFailed;
+
+   if(aio->usePool)
+   {
+      int slot;
+      for(slot=aio->nReads; slot<aio->nReads+aio->nWrites; slot++)
+      {
+         AIOJOB *job = &(aio->jobs[slot]);
+         if(job->inUse)
+         {
+            WaitJob(aio, job);
+            FinishPoolWrite(aio, job);
+         }
+      }
+   }
+
+#ifdef AIO_HAVE_URING
+   if(aio->useRing)
+   {
+      int slot;
+      for(slot=aio->nReads; slot<aio->nReads+aio->nWrites; slot++)
+      {
+         while(aio->jobs[slot].inUse)
+            Reap(aio, TRUE);
+      }
+   }
+#endif
+
+   nFailed      = aio->nFailed;
+   aio->nFailed = 0;
+   return(nFailed);
+}
+
+
+/************************************************************************/
+/*>BOOL WriteFileAtomic(char *outfile, char *data, size_t size)
+   ------------------------------------------------------------
+*//**
+
+   \param[in]      *outfile     File to write
+   \param[in]      *data        Data to write
+   \param[in]      size         Size of the data
+   \return                      Success?
+
+   Writes a file with blocking I/O to outfile.tmp, syncs it and renames
+   it to outfile so that the file either appears complete or not at all
+
+-  18.10.26 Original
+-  18.10.26 The work is done by WriteTmpFile()   By: agent
+*/
+BOOL WriteFileAtomic(char *outfile, char *data, size_t size)
+{
+   char tmpfile[2*MAXBUFF+8];
+   int  error;
+
+   if(snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", outfile)
+      >= (int)sizeof(tmpfile))
+   {
+      fprintf(stderr,"Output filename too long: %s\n", outfile);
+      return(FALSE);
+   }
+   if((error = WriteTmpFile(outfile, tmpfile, data, size)) != 0)
+   {
+      fprintf(stderr,"Error writing %s: %s\n", outfile, strerror(error));
+      return(FALSE);
+   }
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL SyncDirectory(char *dirname)
+   ---------------------------------
+*//**
+
+   \param[in]      *dirname     Directory
+   \return                      Success?
+
+   Syncs a directory so that files renamed into it persist after a
+   crash
+
+-  18.10.26 Original
+*/
+BOOL SyncDirectory(char *dirname)
+{
+   int  fd;
+   BOOL ok;
+
+   if((fd = open(dirname, O_RDONLY)) < 0)
+      return(FALSE);
+   ok = (fsync(fd) == 0);
+   close(fd);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>BOOL SyncFileDirectory(char *filename)
+   --------------------------------------
+*//**
+
+   \param[in]      *filename    File which has been created or renamed
+   \return                      Success?
+
+   Syncs the directory containing a file so that its directory entry
+   persists after a crash
+
+-  18.10.26 Original
+*/
+BOOL SyncFileDirectory(char *filename)
+{
+   char *slash,
+        *dirname;
+   BOOL ok;
+
+   if((slash = strrchr(filename, '/')) == NULL)
+      return(SyncDirectory("."));
+   if(slash == filename)
+      return(SyncDirectory("/"));
+
+   if((dirname = (char *)malloc(slash - filename + 1)) == NULL)
+      return(FALSE);
+   strncpy(dirname, filename, slash - filename);
+   dirname[slash - filename] = '\0';
+   ok = SyncDirectory(dirname);
+   free(dirname);
+
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static BOOL ReadWholeFile(char *filename, char **data, size_t *size)
+   --------------------------------------------------------------------
+*//**
+
+   \param[in]      *filename    File to read
+   \param[out]     **data       File contents, terminated by a '\0'
+   \param[out]     *size        Size of the file
+   \return                      Success? (errno is set on failure)
+
+   Blocking version of a read
+
+-  18.10.26 Original
+*/
+static BOOL ReadWholeFile(char *filename, char **data, size_t *size)
+{
+   struct stat statBuf;
+   int         fd;
+   ssize_t     nRead = 1;
+
+   *data = NULL;
+   *size = 0;
+
+   if((fd = open(filename, O_RDONLY)) < 0)
+      return(FALSE);
+   if(fstat(fd, &statBuf) ||
+      ((*data = (char *)malloc(statBuf.st_size + 1)) == NULL))
+   {
+      if(errno == 0)
+         errno = ENOMEM;
+      close(fd);
+      return(FALSE);
+   }
+
+   while((*size < (size_t)statBuf.st_size) && (nRead != 0))
+   {
+      nRead = read(fd, *data + *size,
+                   MIN(statBuf.st_size - *size, AIO_MAXIO));
+      if(nRead > 0)
+      {
+         *size += nRead;
+      }
+      else if((nRead < 0) && (errno != EINTR))
+      {
+         int error = errno;
+         FREE(*data);
+         *size = 0;
+         close(fd);
+         errno = error;
+         return(FALSE);
+      }
+   }
+   close(fd);
+   (*data)[*size] = '\0';
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static void ClearJob(AIOJOB *job)
+   ---------------------------------
+*//**
+
+   \param[out]     *job         Job slot
+
+   Marks a job slot as free
+
+-  18.10.26 Original
+*/
+static void ClearJob(AIOJOB *job)
+{
+   job->filename = job->tmpfile = job->data = NULL;
+   job->size     = job->done    = 0;
+   job->fd       = -1;
+   job->nPending = job->error   = 0;
+   job->inUse    = job->complete = job->synced = job->closed = FALSE;
+}
+
+
+/************************************************************************/
+/*>static BOOL StartJob(AIOJOB *job, char *filename, BOOL isWrite)
+   ---------------------------------------------------------------
+*//**
+
+   \param[in,out]  *job         Job slot
+   \param[in]      *filename    File to be read or written
+   \param[in]      isWrite      Is this a write?
+   \return                      Success?
+
+   Claims a job slot and stores the filename (and, for writes, the
+   temporary filename)
+
+-  18.10.26 Original
+*/
+static BOOL StartJob(AIOJOB *job, char *filename, BOOL isWrite)
+{
+   job->inUse = TRUE;
+   errno      = 0;
+
+   if((job->filename = strdup(filename)) == NULL)
+      return(FALSE);
+   if(isWrite)
+   {
+      if((job->tmpfile = (char *)malloc(strlen(filename)+5)) == NULL)
+         return(FALSE);
+      sprintf(job->tmpfile, "%s.tmp", filename);
+   }
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static int WriteTmpFile(char *outfile, char *tmpfile, char *data,
+                           size_t size)
+   -----------------------------------------------------------------
+*//**
+
+   \param[in]      *outfile     File to write
+   \param[in]      *tmpfile     Temporary file to write first
+   \param[in]      *data        Data to write
+   \param[in]      size         Size of the data
+   \return                      0 on success, otherwise an errno value
+
+   Writes the data to tmpfile, syncs and closes it and renames it to
+   outfile. The temporary file is removed on failure. Prints nothing, so
+   it may be called from the thread pool.
+
+-  18.10.26 Original - split out of WriteFileAtomic()   By: agent
+*/
+static int WriteTmpFile(char *outfile, char *tmpfile, char *data,
+                        size_t size)
+{
+   size_t done  = 0;
+   int    fd,
+          error = 0;
+
+   if((fd = open(tmpfile, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0)
+      return(errno);
+
+   while(!error && (done < size))
+   {
+      ssize_t nWritten = write(fd, data+done, MIN(size-done, AIO_MAXIO));
+      if(nWritten > 0)
+         done += nWritten;
+      else if((nWritten < 0) && (errno == EINTR))
+         continue;
+      else
+         error = (nWritten < 0) ? errno : EIO;
+   }
+   if(!error && fsync(fd))
+      error = errno;
+   if(close(fd) && !error)
+      error = errno;
+   if(!error && rename(tmpfile, outfile))
+      error = errno;
+
+   if(error)
+      unlink(tmpfile);
+   return(error);
+}
+
+
+/************************************************************************/
+/*>static BOOL StartPool(AIOENGINE *aio)
+   -------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \return                      Was at least one thread started?
+
+   Starts up to AIO_NTHREADS threads to do blocking reads and writes
+   for the engine
+
+-  18.10.26 Original   By: agent
+*/
+static BOOL StartPool(AIOENGINE *aio)
+{
+   int nThreads = MIN(aio->nReads + aio->nWrites, AIO_NTHREADS);
+
+   aio->threads  = NULL;
+   aio->nThreads = 0;
+   aio->stopping = FALSE;
+   aio->readQueue.size  = aio->nReads;
+   aio->writeQueue.size = aio->nWrites;
+   aio->readQueue.head  = aio->readQueue.count  = 0;
+   aio->writeQueue.head = aio->writeQueue.count = 0;
+
+   if(nThreads == 0)
+      return(FALSE);
+   
+   /* +1 so that we never ask for zero bytes                           */
+   aio->readQueue.slots  = (int *)malloc((aio->nReads+1)  * sizeof(int));
+   aio->writeQueue.slots = (int *)malloc((aio->nWrites+1) * sizeof(int));
+   aio->threads = (pthread_t *)malloc(nThreads * sizeof(pthread_t));
+   if((aio->readQueue.slots == NULL) || (aio->writeQueue.slots == NULL) ||
+      (aio->threads == NULL))
+   {
+      FREE(aio->readQueue.slots);
+      FREE(aio->writeQueue.slots);
+      FREE(aio->threads);
+      return(FALSE);
+   }
+
+   pthread_mutex_init(&(aio->lock), NULL);
+   pthread_cond_init(&(aio->workCond), NULL);
+   pthread_cond_init(&(aio->doneCond), NULL);
+
+   for(aio->nThreads=0; aio->nThreads<nThreads; aio->nThreads++)
+   {
+      if(pthread_create(&(aio->threads[aio->nThreads]), NULL, PoolWorker,
+                        aio))
+         break;
+   }
+
+   if(aio->nThreads == 0)
+   {
+      StopPool(aio);
+      return(FALSE);
+   }
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static void StopPool(AIOENGINE *aio)
+   ------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+
+   Tells the threads to stop once the queues are empty, waits for them
+   and frees the pool
+
+-  18.10.26 Original   By: agent
+*/
+static void StopPool(AIOENGINE *aio)
+{
+   int i;
+
+   pthread_mutex_lock(&(aio->lock));
+   aio->stopping = TRUE;
+   pthread_cond_broadcast(&(aio->workCond));
+   pthread_mutex_unlock(&(aio->lock));
+
+   for(i=0; i<aio->nThreads; i++)
+      pthread_join(aio->threads[i], NULL);
+
+   pthread_cond_destroy(&(aio->doneCond));
+   pthread_cond_destroy(&(aio->workCond));
+   pthread_mutex_destroy(&(aio->lock));
+   FREE(aio->readQueue.slots);
+   FREE(aio->writeQueue.slots);
+   FREE(aio->threads);
+   aio->nThreads = 0;
+}
+
+
+/************************************************************************/
+/*>static void *PoolWorker(void *arg)
+   ----------------------------------
+*//**
+
+   \param[in,out]  *arg         I/O engine
+   \return                      NULL
+
+   Thread pool main loop. Takes jobs from the queues, reads before
+   writes, and does them with blocking calls until told to stop.
+
+-  18.10.26 Original   By: agent
+*/
+static void *PoolWorker(void *arg)
+{
+   AIOENGINE *aio = (AIOENGINE *)arg;
+
+   for(;;)
+   {
+      AIOQUEUE *queue;
+      AIOJOB   *job;
+      int      slot;
+
+      pthread_mutex_lock(&(aio->lock));
+      while(!aio->readQueue.count && !aio->writeQueue.count &&
+            !aio->stopping)
+         pthread_cond_wait(&(aio->workCond), &(aio->lock));
+
+      queue = (aio->readQueue.count ? &(aio->readQueue) :
+                                      &(aio->writeQueue));
+      if(queue->count == 0)
+      {
+         /* Stopping and nothing left to do                            */
+         pthread_mutex_unlock(&(aio->lock));
+         break;
+      }
+      slot         = queue->slots[queue->head];
+      queue->head  = (queue->head + 1) % queue->size;
+      queue->count--;
+      pthread_mutex_unlock(&(aio->lock));
+
+      /* Nothing else touches the job until it is marked complete      */
+      job = &(aio->jobs[slot]);
+      if(slot < aio->nReads)
+      {
+         if(!ReadWholeFile(job->filename, &(job->data), &(job->done)))
+            job->error = (errno ? errno : EIO);
+      }
+      else
+      {
+         job->error = WriteTmpFile(job->filename, job->tmpfile,
+                                   job->data, job->size);
+      }
+
+      pthread_mutex_lock(&(aio->lock));
+      job->complete = TRUE;
+      pthread_cond_broadcast(&(aio->doneCond));
+      pthread_mutex_unlock(&(aio->lock));
+   }
+
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>static void QueueJob(AIOENGINE *aio, int slot)
+   ----------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in]      slot         Job slot to hand to the thread pool
+
+   Adds a started job to the read or write queue and wakes a thread.
+   There is room in the queue since each slot is queued at most once.
+
+-  18.10.26 Original   By: agent
+*/
+static void QueueJob(AIOENGINE *aio, int slot)
+{
+   AIOQUEUE *queue = ((slot < aio->nReads) ? &(aio->readQueue) :
+                                             &(aio->writeQueue));
+
+   pthread_mutex_lock(&(aio->lock));
+   queue->slots[(queue->head + queue->count) % queue->size] = slot;
+   queue->count++;
+   pthread_cond_signal(&(aio->workCond));
+   pthread_mutex_unlock(&(aio->lock));
+}
+
+
+/************************************************************************/
+/*>static void WaitJob(AIOENGINE *aio, AIOJOB *job)
+   ------------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in]      *job         Job given to the thread pool
+
+   Waits for the thread pool to finish a job
+
+-  18.10.26 Original   By: agent
+*/
+static void WaitJob(AIOENGINE *aio, AIOJOB *job)
+{
+   pthread_mutex_lock(&(aio->lock));
+   while(!job->complete)
+      pthread_cond_wait(&(aio->doneCond), &(aio->lock));
+   pthread_mutex_unlock(&(aio->lock));
+}
+
+
+/************************************************************************/
+/*>static BOOL PoolWrite(AIOENGINE *aio, char *outfile, char *data,
+                         size_t size)
+   ----------------------------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in]      *outfile     File to write
+   \param[in]      *data        Data to write. The engine frees this
+   \param[in]      size         Size of the data
+   \return                      Success so far?
+
+   Thread pool version of AIOSubmitWrite(). Finishes any writes the
+   pool has completed to free a slot, waiting for one if need be, and
+   queues the write.
+
+-  18.10.26 Original   By: agent
+*/
+static BOOL PoolWrite(AIOENGINE *aio, char *outfile, char *data,
+                      size_t size)
+{
+   AIOJOB *job = NULL;
+   int    slot = 0;
+
+   pthread_mutex_lock(&(aio->lock));
+   while(job == NULL)
+   {
+      for(slot=aio->nReads; slot<aio->nReads+aio->nWrites; slot++)
+      {
+         if(aio->jobs[slot].inUse && aio->jobs[slot].complete)
+            FinishPoolWrite(aio, &(aio->jobs[slot]));
+         if(!aio->jobs[slot].inUse)
+         {
+            job = &(aio->jobs[slot]);
+            break;
+         }
+      }
+      if(job == NULL)
+         pthread_cond_wait(&(aio->doneCond), &(aio->lock));
+   }
+   pthread_mutex_unlock(&(aio->lock));
+
+   job->data = data;
+   job->size = size;
+   if(!StartJob(job, outfile, TRUE))
+   {
+      fprintf(stderr,"Unable to write %s\n", outfile);
+      FREE(job->filename);
+      FREE(job->tmpfile);
+      free(data);
+      ClearJob(job);
+      aio->nFailed++;
+      return(FALSE);
+   }
+
+   QueueJob(aio, slot);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static void FinishPoolWrite(AIOENGINE *aio, AIOJOB *job)
+   --------------------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in,out]  *job         Write job completed by the thread pool
+
+   Reports and counts a failed write and frees the slot
+
+-  18.10.26 Original   By: agent
+*/
+static void FinishPoolWrite(AIOENGINE *aio, AIOJOB *job)
+{
+   if(job->error)
+   {
+      fprintf(stderr,"Error writing %s: %s\n", job->filename,
+              strerror(job->error));
+      aio->nFailed++;
+   }
+
+   FREE(job->data);
+   FREE(job->filename);
+   FREE(job->tmpfile);
+   ClearJob(job);
+}
+
+
+#ifdef AIO_HAVE_URING
+/************************************************************************/
+/*>static BOOL SetupRing(AIOENGINE *aio, int entries)
+   --------------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in]      entries      Number of submission queue entries
+   \return                      Success?
+
+   Creates an io_uring and maps its queues. Fails (so that we fall back
+   to the thread pool) if the kernel does not provide io_uring or does
+   not support the operations we need.
+
+-  18.10.26 Original
+-  18.10.26 Probes for the operations   By: agent
+*/
+static BOOL SetupRing(AIOENGINE *aio, int entries)
+{
+   struct io_uring_params params;
+   char                   *sq, *cq;
+
+   memset(&params, 0, sizeof(params));
+   if((aio->ringfd = syscall(__NR_io_uring_setup, entries, &params)) < 0)
+      return(FALSE);
+
+   /* The probe arrived in 5.6 and NODROP in 5.5, before FAST_POLL   */
+   if(!(params.features & IORING_FEAT_FAST_POLL) ||
+      !(params.features & IORING_FEAT_NODROP)    ||
+      !ProbeRing(aio))
+   {
+      close(aio->ringfd);
+      return(FALSE);
+   }
+
+   aio->sqRingSize = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+   aio->cqRingSize = params.cq_off.cqes +
+                     params.cq_entries * sizeof(struct io_uring_cqe);
+   aio->sqesSize   = params.sq_entries * sizeof(struct io_uring_sqe);
+   if(params.features & IORING_FEAT_SINGLE_MMAP)
+   {
+      aio->sqRingSize = aio->cqRingSize = MAX(aio->sqRingSize,
+                                              aio->cqRingSize);
+   }
+
+   aio->sqRing = mmap(NULL, aio->sqRingSize, PROT_READ|PROT_WRITE,
+                      MAP_SHARED|MAP_POPULATE, aio->ringfd,
+                      IORING_OFF_SQ_RING);
+   if(aio->sqRing == MAP_FAILED)
+   {
+      close(aio->ringfd);
+      return(FALSE);
+   }
+   if(params.features & IORING_FEAT_SINGLE_MMAP)
+   {
+      aio->cqRing = aio->sqRing;
+   }
+   else
+   {
+      aio->cqRing = mmap(NULL, aio->cqRingSize, PROT_READ|PROT_WRITE,
+                         MAP_SHARED|MAP_POPULATE, aio->ringfd,
+                         IORING_OFF_CQ_RING);
+      if(aio->cqRing == MAP_FAILED)
+      {
+         munmap(aio->sqRing, aio->sqRingSize);
+         close(aio->ringfd);
+         return(FALSE);
+      }
+   }
+   aio->sqes = (struct io_uring_sqe *)mmap(NULL, aio->sqesSize,
+                                           PROT_READ|PROT_WRITE,
+                                           MAP_SHARED|MAP_POPULATE,
+                                           aio->ringfd, IORING_OFF_SQES);
+   if(aio->sqes == MAP_FAILED)
+   {
+      if(aio->cqRing != aio->sqRing)
+         munmap(aio->cqRing, aio->cqRingSize);
+      munmap(aio->sqRing, aio->sqRingSize);
+      close(aio->ringfd);
+      return(FALSE);
+   }
+
+   sq = (char *)aio->sqRing;
+   cq = (char *)aio->cqRing;
+   aio->sqHead    = (unsigned *)(sq + params.sq_off.head);
+   aio->sqTail    = (unsigned *)(sq + params.sq_off.tail);
+   aio->sqMask    = (unsigned *)(sq + params.sq_off.ring_mask);
+   aio->sqArray   = (unsigned *)(sq + params.sq_off.array);
+   aio->cqHead    = (unsigned *)(cq + params.cq_off.head);
+   aio->cqTail    = (unsigned *)(cq + params.cq_off.tail);
+   aio->cqMask    = (unsigned *)(cq + params.cq_off.ring_mask);
+   aio->cqes      = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+   aio->sqEntries = params.sq_entries;
+   aio->cqEntries = params.cq_entries;
+   aio->toSubmit  = 0;
+   aio->inFlight  = 0;
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static BOOL ProbeRing(AIOENGINE *aio)
+   -------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \return                      Does the kernel support the operations
+                                we need?
+
+   Asks the kernel which operations it supports. RENAMEAT is optional;
+   without it the rename is done by the caller's thread.
+
+-  18.10.26 Original   By: agent
+*/
+static BOOL ProbeRing(AIOENGINE *aio)
+{
+   static int required[] = {IORING_OP_READ,   IORING_OP_WRITE,
+                            IORING_OP_FSYNC,  IORING_OP_CLOSE,
+                            IORING_OP_OPENAT, IORING_OP_STATX};
+   struct io_uring_probe *probe;
+   size_t                size;
+   int                   i;
+   BOOL                  ok = TRUE;
+
+   size = sizeof(struct io_uring_probe) +
+          IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+   if((probe = (struct io_uring_probe *)calloc(1, size)) == NULL)
+      return(FALSE);
+   if(syscall(__NR_io_uring_register, aio->ringfd, IORING_REGISTER_PROBE,
+              probe, IORING_OP_LAST) < 0)
+   {
+      free(probe);
+      return(FALSE);
+   }
+
+#define OP_SUPPORTED(op) (((op) < probe->ops_len) && \
+                          (probe->ops[(op)].flags & IO_URING_OP_SUPPORTED))
+   for(i=0; i<(int)(sizeof(required)/sizeof(int)); i++)
+   {
+      if(!OP_SUPPORTED(required[i]))
+         ok = FALSE;
+   }
+   aio->ringRename = OP_SUPPORTED(IORING_OP_RENAMEAT);
+#undef OP_SUPPORTED
+
+   free(probe);
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>static void FreeRing(AIOENGINE *aio)
+   ------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+
+-  18.10.26 Original
+*/
+static void FreeRing(AIOENGINE *aio)
+{
+   munmap(aio->sqes, aio->sqesSize);
+   if(aio->cqRing != aio->sqRing)
+      munmap(aio->cqRing, aio->cqRingSize);
+   munmap(aio->sqRing, aio->sqRingSize);
+   close(aio->ringfd);
+}
+
+
+/************************************************************************/
+/*>static void QueueOp(AIOENGINE *aio, int op, int fd, void *addr,
+                       size_t len, uint64_t offset, uint64_t userData,
+                       unsigned flags, unsigned opFlags)
+   ---------------------------------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in]      op           AIO_OP_READ, _WRITE, _FSYNC, _CLOSE,
+                                _OPEN, _STATX or _RENAME
+   \param[in]      fd           File descriptor (AT_FDCWD for OPEN,
+                                STATX and RENAME)
+   \param[in]      *addr        Buffer (reads and writes) or pathname
+   \param[in]      len          Length (reads and writes), mode (OPEN),
+                                mask (STATX) or AT_FDCWD (RENAME)
+   \param[in]      offset       File offset (reads and writes) or
+                                second pointer (STATX buffer, RENAME
+                                new pathname)
+   \param[in]      userData     Returned with the completion
+   \param[in]      flags        Submission flags (e.g. IOSQE_IO_LINK)
+   \param[in]      opFlags      Open flags (OPEN)
+
+   Adds an operation to the submission queue. It is not given to the
+   kernel until the next call to Reap(). MakeRoom() must have been
+   called first.
+
+-  18.10.26 Original
+-  18.10.26 Added OPEN, STATX and RENAME and opFlags   By: agent
+*/
+static void QueueOp(AIOENGINE *aio, int op, int fd, void *addr,
+                    size_t len, uint64_t offset, uint64_t userData,
+                    unsigned flags, unsigned opFlags)
+{
+   struct io_uring_sqe *sqe;
+   unsigned            tail, index;
+
+   tail  = *(aio->sqTail);
+   index = tail & *(aio->sqMask);
+   sqe   = &(aio->sqes[index]);
+
+   memset(sqe, 0, sizeof(struct io_uring_sqe));
+   switch(op)
+   {
+   case AIO_OP_READ:
+      sqe->opcode = IORING_OP_READ;
+      break;
+   case AIO_OP_WRITE:
+      sqe->opcode = IORING_OP_WRITE;
+      break;
+   case AIO_OP_FSYNC:
+      sqe->opcode = IORING_OP_FSYNC;
+      break;
+   case AIO_OP_CLOSE:
+      sqe->opcode = IORING_OP_CLOSE;
+      break;
+   case AIO_OP_OPEN:
+      sqe->opcode     = IORING_OP_OPENAT;
+      sqe->open_flags = opFlags;
+      break;
+   case AIO_OP_STATX:
+      sqe->opcode = IORING_OP_STATX;
+      break;
+   case AIO_OP_RENAME:
+      sqe->opcode = IORING_OP_RENAMEAT;
+      break;
+   }
+   sqe->fd        = fd;
+   sqe->addr      = (uint64_t)(uintptr_t)addr;
+   sqe->len       = (unsigned)len;
+   sqe->off       = offset;
+   sqe->user_data = userData;
+   sqe->flags     = flags;
+
+   aio->sqArray[index] = index;
+   __atomic_store_n(aio->sqTail, tail+1, __ATOMIC_RELEASE);
+   aio->toSubmit++;
+   aio->inFlight++;
+}
+
+
+/************************************************************************/
+/*>static BOOL QueueWrite(AIOENGINE *aio, char *outfile, char *data,
+                          size_t size)
+   -----------------------------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in]      *outfile     File to write
+   \param[in]      *data        Data to write. The engine frees this
+   \param[in]      size         Size of the data
+   \return                      Success so far?
+
+   io_uring version of AIOSubmitWrite(). Queues an OPENAT of the
+   temporary file; QueueWriteOps() queues the rest once it is open.
+
+-  18.10.26 Original
+-  18.10.26 Opens the temporary file on the ring   By: agent
+*/
+static BOOL QueueWrite(AIOENGINE *aio, char *outfile, char *data,
+                       size_t size)
+{
+   AIOJOB *job = NULL;
+   int    slot = 0;
+
+   while(job == NULL)
+   {
+      for(slot=aio->nReads; slot<aio->nReads+aio->nWrites; slot++)
+      {
+         if(!aio->jobs[slot].inUse)
+         {
+            job = &(aio->jobs[slot]);
+            break;
+         }
+      }
+      if(job == NULL)
+         Reap(aio, TRUE);
+   }
+
+   job->data = data;
+   job->size = size;
+   if(!StartJob(job, outfile, TRUE))
+   {
+      fprintf(stderr,"Unable to write %s\n", outfile);
+      FREE(job->filename);
+      FREE(job->tmpfile);
+      free(data);
+      ClearJob(job);
+      aio->nFailed++;
+      return(FALSE);
+   }
+
+   MakeRoom(aio, 1);
+   QueueOp(aio, AIO_OP_OPEN, AT_FDCWD, job->tmpfile, 0644, 0,
+           USERDATA(slot, AIO_OP_OPEN), 0, O_WRONLY|O_CREAT|O_TRUNC);
+   job->nPending = 1;
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>static void QueueWriteOps(AIOENGINE *aio, int slot)
+   ---------------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in]      slot         Write job slot whose temporary file has
+                                just been opened
+
+   Queues a linked WRITE, FSYNC and CLOSE of the temporary file
+
+-  18.10.26 Original - split out of QueueWrite()   By: agent
+*/
+static void QueueWriteOps(AIOENGINE *aio, int slot)
+{
+   AIOJOB *job = &(aio->jobs[slot]);
+
+   /* A short write breaks the link and cancels the FSYNC and CLOSE.
+      RenameWrite() then completes the job with blocking calls
+   */
+   MakeRoom(aio, 3);
+   job->nPending = 2;
+   if(job->size)
+   {
+      QueueOp(aio, AIO_OP_WRITE, job->fd, job->data,
+              MIN(job->size, AIO_MAXIO), 0, USERDATA(slot, AIO_OP_WRITE),
+              IOSQE_IO_LINK, 0);
+      job->nPending++;
+   }
+   QueueOp(aio, AIO_OP_FSYNC, job->fd, NULL, 0, 0,
+           USERDATA(slot, AIO_OP_FSYNC), IOSQE_IO_LINK, 0);
+   QueueOp(aio, AIO_OP_CLOSE, job->fd, NULL, 0, 0,
+           USERDATA(slot, AIO_OP_CLOSE), 0, 0);
+}
+
+
+/************************************************************************/
+/*>static void MakeRoom(AIOENGINE *aio, unsigned nOps)
+   ---------------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in]      nOps         Number of operations about to be queued
+
+   Makes sure that there is room for the operations in the submission
+   queue and that their completions cannot overflow the completion
+   queue
+
+-  18.10.26 Original
+*/
+static void MakeRoom(AIOENGINE *aio, unsigned nOps)
+{
+   while((aio->toSubmit + nOps > aio->sqEntries) ||
+         (aio->inFlight + nOps > aio->cqEntries))
+   {
+      Reap(aio, (aio->toSubmit + nOps <= aio->sqEntries));
+   }
+}
+
+
+/************************************************************************/
+/*>static void Reap(AIOENGINE *aio, BOOL wait)
+   -------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in]      wait         Wait for at least one completion?
+
+   Passes any queued operations to the kernel and handles any completed
+   operations
+
+-  18.10.26 Original
+*/
+static void Reap(AIOENGINE *aio, BOOL wait)
+{
+   unsigned head, tail;
+
+   if(aio->toSubmit || (wait && aio->inFlight))
+   {
+      int ret;
+
+      ret = syscall(__NR_io_uring_enter, aio->ringfd, aio->toSubmit,
+                    (wait ? 1 : 0), (wait ? IORING_ENTER_GETEVENTS : 0),
+                    NULL, 0);
+      if(ret > 0)
+         aio->toSubmit -= MIN((unsigned)ret, aio->toSubmit);
+   }
+
+   /* The head is re-read each time since HandleCompletion() may queue
+      more work and so reap completions itself
+   */
+   while((head = *(aio->cqHead)) !=
+         (tail = __atomic_load_n(aio->cqTail, __ATOMIC_ACQUIRE)))
+   {
+      struct io_uring_cqe *cqe = &(aio->cqes[head & *(aio->cqMask)]);
+      uint64_t            userData = cqe->user_data;
+      int                 res      = cqe->res;
+
+      __atomic_store_n(aio->cqHead, head+1, __ATOMIC_RELEASE);
+      aio->inFlight--;
+      HandleCompletion(aio, userData, res);
+   }
+}
+
+
+/************************************************************************/
+/*>static void HandleCompletion(AIOENGINE *aio, uint64_t userData,
+                                int res)
+   ---------------------------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in]      userData     The operation which has completed
+   \param[in]      res          Its result
+
+   Handles a completed operation. A write job moves on to its next
+   stage: once the temporary file is open, the WRITE, FSYNC and CLOSE
+   are queued, and once they have all completed it is renamed.
+
+-  18.10.26 Original
+-  18.10.26 Reads are handled by HandleReadCompletion(). Added the
+            OPEN and RENAME stages of writes   By: agent
+*/
+static void HandleCompletion(AIOENGINE *aio, uint64_t userData, int res)
+{
+   int    slot = UD_SLOT(userData);
+   AIOJOB *job = &(aio->jobs[slot]);
+
+   if(slot < aio->nReads)
+   {
+      HandleReadCompletion(aio, slot, UD_OP(userData), res);
+      return;
+   }
+
+   switch(UD_OP(userData))
+   {
+   case AIO_OP_OPEN:
+      if(res < 0)
+      {
+         job->error = -res;
+         FinishWrite(aio, job);
+      }
+      else
+      {
+         job->fd = res;
+         QueueWriteOps(aio, slot);
+      }
+      return;
+   case AIO_OP_RENAME:
+      if(res < 0)
+         job->error = -res;
+      FinishWrite(aio, job);
+      return;
+   case AIO_OP_WRITE:
+      if(res < 0)
+         job->error = -res;
+      else
+         job->done += res;
+      break;
+   case AIO_OP_FSYNC:
+      if(res == 0)
+         job->synced = TRUE;
+      else if(res != -ECANCELED)
+         job->error = -res;
+      break;
+   case AIO_OP_CLOSE:
+      if(res == 0)
+         job->closed = TRUE;
+      else if(res != -ECANCELED)
+         job->error = -res;
+      break;
+   }
+
+   if(--(job->nPending) == 0)
+      RenameWrite(aio, slot);
+}
+
+
+/************************************************************************/
+/*>static void HandleReadCompletion(AIOENGINE *aio, int slot, int op,
+                                    int res)
+   -------------------------------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in]      slot         Read job slot
+   \param[in]      op           The operation which has completed
+   \param[in]      res          Its result
+
+   Once both the OPEN and STATX have completed the READ is started.
+   Short reads are continued.
+
+-  18.10.26 Original - split out of HandleCompletion()   By: agent
+*/
+static void HandleReadCompletion(AIOENGINE *aio, int slot, int op,
+                                 int res)
+{
+   AIOJOB *job = &(aio->jobs[slot]);
+
+   switch(op)
+   {
+   case AIO_OP_CLOSE:
+      /* The CLOSE after a read is not waited for and the slot may
+         already have been reused
+      */
+      return;
+   case AIO_OP_OPEN:
+      if(res < 0)
+         job->error = -res;
+      else
+         job->fd = res;
+      if(--(job->nPending) == 0)
+         StartRead(aio, slot);
+      return;
+   case AIO_OP_STATX:
+      if((res < 0) && !job->error)
+         job->error = -res;
+      else if(res == 0)
+         job->size = job->statxBuf.stx_size;
+      if(--(job->nPending) == 0)
+         StartRead(aio, slot);
+      return;
+   }
+
+   /* AIO_OP_READ                                                      */
+   if(res < 0)
+   {
+      job->error    = -res;
+      job->complete = TRUE;
+   }
+   else
+   {
+      job->done += res;
+      if((res == 0) || (job->done >= job->size))
+      {
+         /* res == 0 means the file has shrunk since the STATX          */
+         job->complete = TRUE;
+      }
+      else
+      {
+         MakeRoom(aio, 1);
+         QueueOp(aio, AIO_OP_READ, job->fd, job->data + job->done,
+                 MIN(job->size - job->done, AIO_MAXIO), job->done,
+                 USERDATA(slot, AIO_OP_READ), 0, 0);
+      }
+   }
+}
+
+
+/************************************************************************/
+/*>static void StartRead(AIOENGINE *aio, int slot)
+   -----------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in]      slot         Read job slot whose file has been opened
+                                and sized
+
+   Allocates the buffer and queues the READ, or completes the job if
+   the OPEN or STATX failed or the file is empty. An open descriptor is
+   closed by AIOWaitRead() whatever happens.
+
+-  18.10.26 Original   By: agent
+*/
+static void StartRead(AIOENGINE *aio, int slot)
+{
+   AIOJOB *job = &(aio->jobs[slot]);
+
+   if(!job->error &&
+      ((job->data = (char *)malloc(job->size + 1)) == NULL))
+      job->error = ENOMEM;
+
+   if(job->error || (job->size == 0))
+   {
+      job->complete = TRUE;
+      return;
+   }
+
+   MakeRoom(aio, 1);
+   QueueOp(aio, AIO_OP_READ, job->fd, job->data,
+           MIN(job->size, AIO_MAXIO), 0, USERDATA(slot, AIO_OP_READ),
+           0, 0);
+}
+
+
+/************************************************************************/
+/*>static void RenameWrite(AIOENGINE *aio, int slot)
+   -------------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in]      slot         Write job slot whose WRITE, FSYNC and
+                                CLOSE have completed
+
+   Completes a write whose chain was broken by a short write using
+   blocking calls, then queues the RENAMEAT of the temporary file to
+   the output file. Kernels without RENAMEAT get a blocking rename().
+
+-  18.10.26 Original - split out of FinishWrite()   By: agent
+*/
+static void RenameWrite(AIOENGINE *aio, int slot)
+{
+   AIOJOB *job = &(aio->jobs[slot]);
+
+   while(!job->error && (job->done < job->size))
+   {
+      ssize_t nWritten = pwrite(job->fd, job->data + job->done,
+                                MIN(job->size - job->done, AIO_MAXIO),
+                                job->done);
+      if(nWritten > 0)
+         job->done += nWritten;
+      else if((nWritten < 0) && (errno == EINTR))
+         continue;
+      else
+         job->error = (errno ? errno : EIO);
+   }
+   if(!job->error && !job->synced && fsync(job->fd))
+      job->error = errno;
+   if(!job->closed && close(job->fd) && !job->error)
+      job->error = errno;
+
+   if(!job->error && aio->ringRename)
+   {
+      MakeRoom(aio, 1);
+      QueueOp(aio, AIO_OP_RENAME, AT_FDCWD, job->tmpfile,
+              (unsigned)AT_FDCWD, (uint64_t)(uintptr_t)job->filename,
+              USERDATA(slot, AIO_OP_RENAME), 0, 0);
+      return;
+   }
+
+   if(!job->error && rename(job->tmpfile, job->filename))
+      job->error = errno;
+   FinishWrite(aio, job);
+}
+
+
+/************************************************************************/
+/*>static void FinishWrite(AIOENGINE *aio, AIOJOB *job)
+   ----------------------------------------------------
+*//**
+
+   \param[in,out]  *aio         I/O engine
+   \param[in,out]  *job         Write job
+
+   Reports and counts a failed write, removing the temporary file, and
+   frees the slot
+
+-  18.10.26 Original
+-  18.10.26 Blocking completion and rename moved to RenameWrite()
+            By: agent
+*/
+static void FinishWrite(AIOENGINE *aio, AIOJOB *job)
+{
+   if(job->error)
+   {
+      unlink(job->tmpfile);
+      fprintf(stderr,"Error writing %s: %s\n", job->filename,
+              strerror(job->error));
+      aio->nFailed++;
+   }
+
+   FREE(job->data);
+   FREE(job->filename);
+   FREE(job->tmpfile);
+   ClearJob(job);
+}
+#endif
@@ -0,0 +1,20 @@
+#ifndef _AsyncIO_h_
+#define _AsyncIO_h_ 1
+
+#include <stddef.h>
+
+typedef struct _aioengine AIOENGINE;
+
+AIOENGINE *CreateAIOEngine(int nReads, int nWrites);
+void FreeAIOEngine(AIOENGINE *aio);
+char *AIOEngineName(AIOENGINE *aio);
+int  AIOSubmitRead(AIOENGINE *aio, char *filename);
+BOOL AIOWaitRead(AIOENGINE *aio, int ticket, char **data, size_t *size);
+BOOL AIOSubmitWrite(AIOENGINE *aio, char *outfile, char *data,
+                    size_t size);
+int  AIOFlushWrites(AIOENGINE *aio);
+BOOL WriteFileAtomic(char *outfile, char *data, size_t size);
+BOOL SyncDirectory(char *dirname);
+BOOL SyncFileDirectory(char *filename);
+
+#endif
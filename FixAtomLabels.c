@@ -4,8 +4,8 @@
    Program:    
    \file       FixAtomLabels.c
    
-   \version    V1.0
-   \date       13.03.23   
+   \version    V1.7
+   \date       18.10.26   
    \brief      Routines to fix symmetrical atom labels
    
    \copyright  (c) UCL / Prof. Andrew C. R. Martin 2023
@@ -51,25 +51,127 @@
    Revision History:
    =================
    V1.0    13.03.23   Original   By: ACRM
+   V1.1    18.10.26   blFixAtomLabels() returns the number of residues
+                      swapped
+                      By: agent
+   V1.2    18.10.26   Added torsion statistics routines   By: agent
+   V1.3    18.10.26   Swaps the whole group of symmetrical atoms
+                      including hydrogens using a table for each residue
+                      type
+                      By: agent
+   V1.4    18.10.26   Torsions and swap decisions for a structure are
+                      calculated in one call to a geometry kernel chosen
+                      for the CPU at run time. Added blTestGeomKernels()
+                      By: agent
+   V1.5    18.10.26   Torsion statistics use circular means and standard
+                      deviations
+                      By: agent
+   V1.6    18.10.26   blPrintTorsionAtomLabels() uses the geometry kernel
+                      so there is only one torsion calculation.
+                      blTestGeomKernels() checks all the kernels against
+                      blPhi()
+                      By: agent
+   V1.7    18.10.26   ASP and GLU hydrogens are swapped with the oxygens.
+                      A residue where one of a pair of symmetrical atoms
+                      is present without the other (such as ASP with a
+                      proton on only one oxygen) is not swapped, since
+                      that atom would be left with the wrong name
+                      By: agent
 
 *************************************************************************/
 /* Includes
 */
 #include <math.h>
+#include <string.h>
 
 #include "bioplib/pdb.h"
 #include "bioplib/macros.h"
 #include "bioplib/angle.h"
 #include "FixAtomLabels.h"
+#include "GeomKernels.h"
 
 /************************************************************************/
 /* Defines and macros
 */
 #define FAL_ERROR_VALUE 9999.0
+#define MAXSWAPPAIRS    4    /* Max pairs of atoms swapped in a residue */
+
+/************************************************************************/
+/* Type definitions
+*/
+/* Residues gathered from a structure to be passed to a geometry kernel */
+typedef struct
+{
+   PDB  **res,
+        **nextres,
+        **unpaired;
+   REAL *coords,
+        *tor1,
+        *tor2;
+   BOOL *isSP3,
+        *swap,
+        *complete;
+   int  *resType,
+        n,
+        maxN;
+}  TORSIONSET;
 
 /************************************************************************/
 /* Globals
 */
+/* Residue types handled and, for each, the atoms defining the two
+   torsions. Atoms 0-2 are common and atoms 3 and 4 are the pair of
+   symmetrical atoms. The order must match blTorsionStatsResnam[]
+*/
+static char *sTorsionAtoms[FAL_NRESTYPES][5] = 
+{
+   {"CA  ", "CB  ", "CG  ", "CD1 ", "CD2 "},  /* LEU                    */
+   {"N   ", "CA  ", "CB  ", "CG1 ", "CG2 "},  /* VAL                    */
+   {"CA  ", "CB  ", "CG  ", "CD1 ", "CD2 "},  /* PHE                    */
+   {"CA  ", "CB  ", "CG  ", "CD1 ", "CD2 "},  /* TYR                    */
+   {"CA  ", "CB  ", "CG  ", "OD1 ", "OD2 "},  /* ASP                    */
+   {"CB  ", "CG  ", "CD  ", "OE1 ", "OE2 "},  /* GLU                    */
+   {"CD  ", "NE  ", "CZ  ", "NH1 ", "NH2 "}   /* ARG                    */
+#ifdef ILE
+  ,{"N   ", "CA  ", "CB  ", "CG2 ", "CG1 "}   /* ILE - other way round! */
+#endif
+};
+
+/* For each residue type, the pairs of atoms whose coordinates are
+   swapped to fix the labelling. The first pair is atoms 3 and 4 from 
+   sTorsionAtoms[]; the rest are atoms (including hydrogens) which hang
+   off them. Unused pairs are NULL. The order must match 
+   blTorsionStatsResnam[]
+*/
+static char *sSwapPairs[FAL_NRESTYPES][MAXSWAPPAIRS][2] =
+{
+   {{"CD1 ", "CD2 "}, {"HD11", "HD21"},          /* LEU                 */
+    {"HD12", "HD22"}, {"HD13", "HD23"}},
+   {{"CG1 ", "CG2 "}, {"HG11", "HG21"},          /* VAL                 */
+    {"HG12", "HG22"}, {"HG13", "HG23"}},
+   {{"CD1 ", "CD2 "}, {"CE1 ", "CE2 "},          /* PHE                 */
+    {"HD1 ", "HD2 "}, {"HE1 ", "HE2 "}},
+   {{"CD1 ", "CD2 "}, {"CE1 ", "CE2 "},          /* TYR                 */
+    {"HD1 ", "HD2 "}, {"HE1 ", "HE2 "}},
+   {{"OD1 ", "OD2 "}, {"HD1 ", "HD2 "},          /* ASP                 */
+    {NULL,   NULL  }, {NULL,   NULL  }},
+   {{"OE1 ", "OE2 "}, {"HE1 ", "HE2 "},          /* GLU                 */
+    {NULL,   NULL  }, {NULL,   NULL  }},
+   {{"NH1 ", "NH2 "}, {"HH11", "HH21"},          /* ARG                 */
+    {"HH12", "HH22"}, {NULL,   NULL  }}
+#ifdef ILE
+  ,{{"CG2 ", "CG1 "}, {NULL,   NULL  },          /* ILE                 */
+    {NULL,   NULL  }, {NULL,   NULL  }}
+#endif
+};
+
+char *blTorsionStatsResnam[FAL_NRESTYPES] =
+{
+   "LEU", "VAL", "PHE", "TYR", "ASP", "GLU", "ARG"
+#ifdef ILE
+  ,"ILE"
+#endif
+};
 
 /************************************************************************/
 /* Prototypes
@@ -79,340 +181,143 @@ static REAL AngleDistanceFromZero(REAL angle);
 static void SwapAtomCoords(PDB *atom1, PDB *atom2);
 static REAL CalcAngleDiff(REAL tor1, REAL tor2);
 static REAL CalcTorsion(PDB *p1, PDB *p2, PDB *p3, PDB *p4, BOOL Radians);
+static int  FindTorsionAtoms(PDB *res, PDB **atom);
+static PDB  *FindSwapAtoms(PDB *res, PDB *nextres, int resType,
+                           PDB *atom[MAXSWAPPAIRS][2]);
+static void SwapAtomGroup(PDB *res, PDB *nextres, int resType);
+static TORSIONSET *GatherTorsionSet(PDB *pdb, BOOL keepIncomplete);
+static void FreeTorsionSet(TORSIONSET *set);
+static BOOL IsSP3ResType(int resType);
+static void InitAngleStats(FALANGLESTATS *stats, BOOL circular);
+static void AccumulateAngle(FALANGLESTATS *stats, REAL angle, REAL low);
+static void WriteAngleStats(FILE *out, char *name, FALANGLESTATS *stats,
+                            REAL low, BOOL last);
 
 /************************************************************************/
-void blFixAtomLabels(PDB *pdb, int verbose)
+int blFixAtomLabels(PDB *pdb, int verbose)
 {
-   PDB *res     = NULL,
-       *nextres = NULL;
+   TORSIONSET *set;
+   int        i,
+              nSwaps = 0;
 
-   for(res=pdb; res!=NULL; res=nextres)
+   if((set = GatherTorsionSet(pdb, FALSE)) == NULL)
+      return(-1);
+
+   (*blGetGeomKernel())(set->n, set->maxN, set->coords, set->isSP3,
+                        set->tor1, set->tor2, set->swap);
+   
+   for(i=0; i<set->n; i++)
    {
-      PDB *atom[8];
-      REAL tor1, tor2, diff;
-      int i;
-      for(i=0; i<8; i++)
-         atom[i] = NULL;
-            
-      nextres = blFindNextResidue(res);
-      if(!strncmp(res->resnam, "LEU", 3) ||
-         !strncmp(res->resnam, "PHE", 3) ||
-         !strncmp(res->resnam, "TYR", 3))
-      {
-         atom[0] = blFindAtomInRes(res, "CA  ");
-         atom[1] = blFindAtomInRes(res, "CB  ");
-         atom[2] = blFindAtomInRes(res, "CG  ");
-         atom[3] = blFindAtomInRes(res, "CD1 ");
-         atom[4] = blFindAtomInRes(res, "CD2 ");
-      }
-      else if(!strncmp(res->resnam, "VAL", 3))
-      {
-         atom[0] = blFindAtomInRes(res, "N   ");
-         atom[1] = blFindAtomInRes(res, "CA  ");
-         atom[2] = blFindAtomInRes(res, "CB  ");
-         atom[3] = blFindAtomInRes(res, "CG1 ");
-         atom[4] = blFindAtomInRes(res, "CG2 ");
-      }
-#ifdef ILE
-      else if(!strncmp(res->resnam, "ILE", 3))
-      {
-         atom[0] = blFindAtomInRes(res, "N   ");
-         atom[1] = blFindAtomInRes(res, "CA  ");
-         atom[2] = blFindAtomInRes(res, "CB  ");
-         /* Note this is the other way round! */
-         atom[3] = blFindAtomInRes(res, "CG2 ");
-         atom[4] = blFindAtomInRes(res, "CG1 ");
-      }
-#endif
-      else if(!strncmp(res->resnam, "ASP", 3))
-      {
-         atom[0] = blFindAtomInRes(res, "CA  ");
-         atom[1] = blFindAtomInRes(res, "CB  ");
-         atom[2] = blFindAtomInRes(res, "CG  ");
-         atom[3] = blFindAtomInRes(res, "OD1 ");
-         atom[4] = blFindAtomInRes(res, "OD2 ");
-      }
-      else if(!strncmp(res->resnam, "GLU", 3))
-      {
-         atom[0] = blFindAtomInRes(res, "CB  ");
-         atom[1] = blFindAtomInRes(res, "CG  ");
-         atom[2] = blFindAtomInRes(res, "CD  ");
-         atom[3] = blFindAtomInRes(res, "OE1 ");
-         atom[4] = blFindAtomInRes(res, "OE2 ");
-      }
-      else if(!strncmp(res->resnam, "ARG", 3))
+      PDB *res = set->res[i];
+      
+      if(set->swap[i] && (set->unpaired[i] != NULL))
       {
-         atom[0] = blFindAtomInRes(res, "CD  ");
-         atom[1] = blFindAtomInRes(res, "NE  ");
-         atom[2] = blFindAtomInRes(res, "CZ  ");
-         atom[3] = blFindAtomInRes(res, "NH1 ");
-         atom[4] = blFindAtomInRes(res, "NH2 ");
+         if(verbose >= 1)
+         {
+            fprintf(stderr,"Cannot swap atom labels for %s %s%d%s as \
+%.*s has no partner\n",
+                    res->resnam,
+                    res->chain,
+                    res->resnum,
+                    res->insert,
+                    (int)strcspn(set->unpaired[i]->atnam, " "),
+                    set->unpaired[i]->atnam);
+         }
       }
-      
-      if(atom[0] != NULL)
+      else if(set->swap[i])
       {
-         tor1 = CalcTorsion(atom[0],atom[1],atom[2],atom[3],FALSE);
-         tor2 = CalcTorsion(atom[0],atom[1],atom[2],atom[4],FALSE);
-
-         if((tor1 < FAL_ERROR_VALUE-1) && (tor2 < FAL_ERROR_VALUE-1))
+         if(verbose >= 1)
          {
-            if(!strncmp(res->resnam, "LEU", 3) ||
-#ifdef ILE
-               !strncmp(res->resnam, "ILE", 3) ||
-#endif
-               !strncmp(res->resnam, "VAL", 3))
-            {
-            
-               diff = CalcAngleDiff(tor1, tor2);
-         
-               if((diff < 90) || (diff > 180))
-               {
-                  if(verbose >= 1)
-                  {
-                     fprintf(stderr,"Swapped atom labels for %s %s%d%s\n",
-                             atom[0]->resnam,
-                             atom[0]->chain,
-                             atom[0]->resnum,
-                             atom[0]->insert);
-                  }
-                  SwapAtomCoords(atom[3], atom[4]);
-               }
-               else if(verbose >= 2)
-               {
-                  fprintf(stderr,"Atom labels for %s %s%d%s are OK\n",
-                          atom[0]->resnam,
-                          atom[0]->chain,
-                          atom[0]->resnum,
-                          atom[0]->insert);
-               }
-            }
-            else /* PHE, TYR, ASP, GLU, ARG                             */
-            {
-               if(NeedToSwapSP2Atoms(tor1, tor2))
-               {
-                  if(verbose >= 1)
-                  {
-                     fprintf(stderr,"Swapped atom labels for %s %s%d%s\n",
-                             atom[0]->resnam,
-                             atom[0]->chain,
-                             atom[0]->resnum,
-                             atom[0]->insert);
-                  }
-
-                  SwapAtomCoords(atom[3], atom[4]);
-                  
-                  if(!strncmp(res->resnam, "PHE", 3) ||
-                     !strncmp(res->resnam, "TYR", 3))
-                  {
-                     atom[5] = blFindAtomInRes(res, "CE1 ");
-                     atom[6] = blFindAtomInRes(res, "CE2 ");
-                     
-                     SwapAtomCoords(atom[5], atom[6]);
-                  }
-               }
-               else if(verbose >= 2)
-               {
-                  fprintf(stderr,"Atom labels for %s %s%d%s are OK\n",
-                          atom[0]->resnam,
-                          atom[0]->chain,
-                          atom[0]->resnum,
-                          atom[0]->insert);
-               }
-            }
+            fprintf(stderr,"Swapped atom labels for %s %s%d%s\n",
+                    res->resnam,
+                    res->chain,
+                    res->resnum,
+                    res->insert);
          }
+         SwapAtomGroup(res, set->nextres[i], set->resType[i]);
+         nSwaps++;
+      }
+      else if(verbose >= 2)
+      {
+         fprintf(stderr,"Atom labels for %s %s%d%s are OK\n",
+                 res->resnam,
+                 res->chain,
+                 res->resnum,
+                 res->insert);
       }
    }
+
+   FreeTorsionSet(set);
+   return(nSwaps);
 }
 
 /************************************************************************/
+/*>void blPrintTorsionAtomLabels(FILE *out, PDB *pdb)
+   --------------------------------------------------
+*//**
+
+   \param[in]      *out         Output file pointer
+   \param[in]      *pdb         PDB linked list
+
+   Reports the torsions for each residue with symmetrical atoms and
+   whether the labels need swapping. For SP3 residues the difference
+   between the torsions is also given. Residues with atoms missing are
+   reported as such, as are residues which need swapping but where one
+   of a pair of symmetrical atoms has no partner.
+
+-  13.03.23 Original
+-  18.10.26 Uses the geometry kernel   By: agent
+-  18.10.26 Reports residues which cannot be swapped   By: agent
+*/
 void blPrintTorsionAtomLabels(FILE *out, PDB *pdb)
 {
-   PDB  *res     = NULL,
-        *nextres = NULL;
-   char resspec[16];
-   
-   
-   for(res=pdb; res!=NULL; res=nextres)
-   {
-      nextres = blFindNextResidue(res);
-      blBuildResSpec(res, resspec);
-      
-      if(!strncmp(res->resnam, "LEU", 3))
-      {
-         PDB *CA, *CB, *CG, *CD1, *CD2;
-         REAL tor1, tor2, diff;
-         char label[16];
-            
-         CA  = blFindAtomInRes(res, "CA  ");
-         CB  = blFindAtomInRes(res, "CB  ");
-         CG  = blFindAtomInRes(res, "CG  ");
-         CD1 = blFindAtomInRes(res, "CD1 ");
-         CD2 = blFindAtomInRes(res, "CD2 ");
-         
-         tor1 = CalcTorsion(CA, CB, CG, CD1, FALSE);
-         tor2 = CalcTorsion(CA, CB, CG, CD2, FALSE);
+   TORSIONSET *set;
+   int        i;
 
-         diff = CalcAngleDiff(tor1, tor2);
-         strcpy(label, "OK");
-         
-         if((diff < 90) || (diff > 180))
-            strcpy(label, "SWAPPED!");
-         
-         fprintf(out, "%s %6s Tor1: %8.3f Tor2: %8.3f %s \
-(Diff: %8.3f)\n",
-                 res->resnam, resspec, tor1, tor2, label, diff);
-      }
-      else if(!strncmp(res->resnam, "VAL", 3))
-      {
-         PDB *N, *CA, *CB, *CG1, *CG2;
-         REAL tor1, tor2, diff;
-         char label[16];
-            
-         N   = blFindAtomInRes(res, "N   ");
-         CA  = blFindAtomInRes(res, "CA  ");
-         CB  = blFindAtomInRes(res, "CB  ");
-         CG1 = blFindAtomInRes(res, "CG1 ");
-         CG2 = blFindAtomInRes(res, "CG2 ");
-         
-         tor1 = CalcTorsion(N, CA, CB, CG1, FALSE);
-         tor2 = CalcTorsion(N, CA, CB, CG2, FALSE);
+   if((set = GatherTorsionSet(pdb, TRUE)) == NULL)
+   {
+      fprintf(stderr,"No memory to calculate torsions\n");
+      return;
+   }
 
-         diff = CalcAngleDiff(tor1, tor2);
-         strcpy(label, "OK");
-         
-         if((diff < 90) || (diff > 180))
-            strcpy(label, "SWAPPED!");
-         
-         fprintf(out, "%s %6s Tor1: %8.3f Tor2: %8.3f %s \
-(Diff: %8.3f)\n",
-                 res->resnam, resspec, tor1, tor2, label, diff);
+   (*blGetGeomKernel())(set->n, set->maxN, set->coords, set->isSP3,
+                        set->tor1, set->tor2, set->swap);
 
-      }
-#ifdef ILE
-      else if(!strncmp(res->resnam, "ILE", 3))
-      {
-         PDB  *N, *CA, *CB, *CG1, *CG2;
-         REAL tor1, tor2, diff;
-         char label[16];
-            
-         N   = blFindAtomInRes(res, "N   ");
-         CA  = blFindAtomInRes(res, "CA  ");
-         CB  = blFindAtomInRes(res, "CB  ");
-         CG1 = blFindAtomInRes(res, "CG1 ");
-         CG2 = blFindAtomInRes(res, "CG2 ");
-
-         /* Note this is the other way round! */
-         tor1 = CalcTorsion(N, CA, CB, CG2, FALSE);
-         tor2 = CalcTorsion(N, CA, CB, CG1, FALSE);
-
-         diff = CalcAngleDiff(tor1, tor2);
-         strcpy(label, "OK");
-         
-         if((diff < 90) || (diff > 180))
-            strcpy(label, "SWAPPED!");
-         
-         fprintf(out, "%s %6s Tor1: %8.3f Tor2: %8.3f %s \
-(Diff: %8.3f)\n",
-                 res->resnam, resspec, tor1, tor2, label, diff);
+   for(i=0; i<set->n; i++)
+   {
+      PDB  *res = set->res[i];
+      char resspec[16],
+           *label;
 
-      }
-#endif
-      else if(!strncmp(res->resnam, "PHE", 3) ||
-              !strncmp(res->resnam, "TYR", 3))
+      blBuildResSpec(res, resspec);
+      if(!set->complete[i])
       {
-         PDB *CA, *CB, *CG, *CD1, *CD2;
-         REAL tor1, tor2;
-         char label[16];
-            
-         CA  = blFindAtomInRes(res, "CA  ");
-         CB  = blFindAtomInRes(res, "CB  ");
-         CG  = blFindAtomInRes(res, "CG  ");
-         CD1 = blFindAtomInRes(res, "CD1 ");
-         CD2 = blFindAtomInRes(res, "CD2 ");
-         
-         tor1 = CalcTorsion(CA, CB, CG, CD1, FALSE);
-         tor2 = CalcTorsion(CA, CB, CG, CD2, FALSE);
-
-         strcpy(label, "OK");
-         
-         if(NeedToSwapSP2Atoms(tor1, tor2))
-            strcpy(label, "SWAPPED!");
-         
-         fprintf(out, "%s %6s Tor1: %8.3f Tor2: %8.3f %s \n",
-                 res->resnam, resspec, tor1, tor2, label);
-
+         fprintf(out, "%s %6s Tor1: %8.3f Tor2: %8.3f MISSING ATOMS\n",
+                 res->resnam, resspec, FAL_ERROR_VALUE, FAL_ERROR_VALUE);
+         continue;
       }
-      else if(!strncmp(res->resnam, "ASP", 3))
-      {
-         PDB *CA, *CB, *CG, *OD1, *OD2;
-         REAL tor1, tor2;
-         char label[16];
-            
-         CA  = blFindAtomInRes(res, "CA  ");
-         CB  = blFindAtomInRes(res, "CB  ");
-         CG  = blFindAtomInRes(res, "CG  ");
-         OD1 = blFindAtomInRes(res, "OD1 ");
-         OD2 = blFindAtomInRes(res, "OD2 ");
-         
-         tor1 = CalcTorsion(CA, CB, CG, OD1, FALSE);
-         tor2 = CalcTorsion(CA, CB, CG, OD2, FALSE);
 
-         strcpy(label, "OK");
-         if(NeedToSwapSP2Atoms(tor1, tor2))
-         {
-            strcpy(label, "SWAPPED!");
-         }
-         fprintf(out, "%s %6s Tor1: %8.3f Tor2: %8.3f %s \n",
-                 res->resnam, resspec, tor1, tor2, label);
-      }
-      else if(!strncmp(res->resnam, "GLU", 3))
+      if(!set->swap[i])
+         label = "OK";
+      else if(set->unpaired[i] != NULL)
+         label = "CANNOT SWAP";
+      else
+         label = "SWAPPED!";
+      if(set->isSP3[i])
       {
-         PDB  *CB, *CG, *CD, *OE1, *OE2;
-         REAL tor1, tor2;
-         char label[16];
-            
-         CB  = blFindAtomInRes(res, "CB  ");
-         CG  = blFindAtomInRes(res, "CG  ");
-         CD  = blFindAtomInRes(res, "CD  ");
-         OE1 = blFindAtomInRes(res, "OE1 ");
-         OE2 = blFindAtomInRes(res, "OE2 ");
-         
-         tor1 = CalcTorsion(CB, CG, CD, OE1, FALSE);
-         tor2 = CalcTorsion(CB, CG, CD, OE2, FALSE);
-
-         strcpy(label, "OK");
-         if(NeedToSwapSP2Atoms(tor1, tor2))
-         {
-            strcpy(label, "SWAPPED!");
-         }
-         
-         fprintf(out, "%s %6s Tor1: %8.3f Tor2: %8.3f %s \n",
-                 res->resnam, resspec, tor1, tor2, label);
+         fprintf(out, "%s %6s Tor1: %8.3f Tor2: %8.3f %s \
+(Diff: %8.3f)\n",
+                 res->resnam, resspec, set->tor1[i], set->tor2[i], label,
+                 CalcAngleDiff(set->tor1[i], set->tor2[i]));
       }
-      else if(!strncmp(res->resnam, "ARG", 3))
+      else
       {
-         PDB  *CD, *NE, *CZ, *NH1, *NH2;
-         REAL tor1, tor2;
-         char label[16];
-            
-         CD  = blFindAtomInRes(res, "CD  ");
-         NE  = blFindAtomInRes(res, "NE  ");
-         CZ  = blFindAtomInRes(res, "CZ  ");
-         NH1 = blFindAtomInRes(res, "NH1 ");
-         NH2 = blFindAtomInRes(res, "NH2 ");
-
-         tor1 = CalcTorsion(CD, NE, CZ, NH1, FALSE);
-         tor2 = CalcTorsion(CD, NE, CZ, NH2, FALSE);
-
-         strcpy(label, "OK");
-         if(NeedToSwapSP2Atoms(tor1, tor2))
-         {
-            strcpy(label, "SWAPPED!");
-         }
          fprintf(out, "%s %6s Tor1: %8.3f Tor2: %8.3f %s \n",
-                 res->resnam, resspec, tor1, tor2, label);
+                 res->resnam, resspec, set->tor1[i], set->tor2[i], label);
       }
    }
+
+   FreeTorsionSet(set);
 }
 
 /************************************************************************/
@@ -451,6 +356,90 @@ static void SwapAtomCoords(PDB *atom1, PDB *atom2)
 }
 
 
+/************************************************************************/
+/*>static PDB *FindSwapAtoms(PDB *res, PDB *nextres, int resType,
+                             PDB *atom[MAXSWAPPAIRS][2])
+   ---------------------------------------------------------------
+*//**
+
+   \param[in]      *res         Start of residue
+   \param[in]      *nextres     Start of next residue
+   \param[in]      resType      Residue type from FindTorsionAtoms()
+   \param[out]     *atom        The pairs of atoms listed in
+                                sSwapPairs[] (NULL where not found)
+   \return                      An atom whose partner is missing (NULL
+                                if every pair is complete or absent)
+
+   Scans the residue once to find all the pairs of symmetrical atoms.
+   If one atom of a pair is present without the other then the residue
+   cannot be swapped: for example in ASP with a proton on OD2 only,
+   swapping the oxygens would leave HD2 on the atom now named OD1.
+
+-  18.10.26 Original - split out of SwapAtomGroup()   By: agent
+*/
+static PDB *FindSwapAtoms(PDB *res, PDB *nextres, int resType,
+                          PDB *atom[MAXSWAPPAIRS][2])
+{
+   PDB *p;
+   int i, j;
+
+   for(i=0; i<MAXSWAPPAIRS; i++)
+      atom[i][0] = atom[i][1] = NULL;
+
+   for(p=res; p!=nextres; NEXT(p))
+   {
+      for(i=0; (i<MAXSWAPPAIRS) && (sSwapPairs[resType][i][0]!=NULL); i++)
+      {
+         for(j=0; j<2; j++)
+         {
+            if((atom[i][j] == NULL) &&
+               !strncmp(p->atnam, sSwapPairs[resType][i][j], 4))
+               atom[i][j] = p;
+         }
+      }
+   }
+
+   for(i=0; i<MAXSWAPPAIRS; i++)
+   {
+      if((atom[i][0] == NULL) != (atom[i][1] == NULL))
+         return((atom[i][0] != NULL) ? atom[i][0] : atom[i][1]);
+   }
+   return(NULL);
+}
+
+
+/************************************************************************/
+/*>static void SwapAtomGroup(PDB *res, PDB *nextres, int resType)
+   --------------------------------------------------------------
+*//**
+
+   \param[in,out]  *res         Start of residue
+   \param[in]      *nextres     Start of next residue
+   \param[in]      resType      Residue type from FindTorsionAtoms()
+
+   Swaps the coordinates of all the pairs of symmetrical atoms in the
+   residue listed in sSwapPairs[], including any hydrogens, so that 
+   protonated structures stay consistent. Pairs where neither atom is
+   present are skipped; the caller must not swap a residue for which
+   FindSwapAtoms() finds an atom without its partner.
+
+-  18.10.26 Original   By: agent
+-  18.10.26 Atoms are found by FindSwapAtoms()   By: agent
+*/
+static void SwapAtomGroup(PDB *res, PDB *nextres, int resType)
+{
+   PDB *atom[MAXSWAPPAIRS][2];
+   int i;
+
+   FindSwapAtoms(res, nextres, resType, atom);
+   for(i=0; i<MAXSWAPPAIRS; i++)
+   {
+      if((atom[i][0] != NULL) && (atom[i][1] != NULL))
+         SwapAtomCoords(atom[i][0], atom[i][1]);
+   }
+}
+
+
 
 /************************************************************************/
 static REAL CalcAngleDiff(REAL tor1, REAL tor2)
@@ -487,3 +476,559 @@ static REAL CalcTorsion(PDB *p1, PDB *p2, PDB *p3, PDB *p4, BOOL Radians)
    return(tor);
 }
 
+
+/************************************************************************/
+/*>static int FindTorsionAtoms(PDB *res, PDB **atom)
+   -------------------------------------------------
+*//**
+
+   \param[in]      *res         Start of a residue
+   \param[out]     **atom       The 5 atoms defining the torsions
+   \return                      Residue type (index into
+                                blTorsionStatsResnam[]) or -1 if not
+                                a residue we handle
+
+-  18.10.26 Original   By: agent
+*/
+static int FindTorsionAtoms(PDB *res, PDB **atom)
+{
+   int resType, i;
+
+   for(resType=0; resType<FAL_NRESTYPES; resType++)
+   {
+      if(!strncmp(res->resnam, blTorsionStatsResnam[resType], 3))
+      {
+         for(i=0; i<5; i++)
+            atom[i] = blFindAtomInRes(res, sTorsionAtoms[resType][i]);
+         return(resType);
+      }
+   }
+   return(-1);
+}
+
+
+/************************************************************************/
+/*>static BOOL IsSP3ResType(int resType)
+   -------------------------------------
+*//**
+
+   \param[in]      resType      Residue type from FindTorsionAtoms()
+   \return                      Are the symmetrical atoms SP3 (LEU, VAL,
+                                ILE) rather than SP2?
+
+-  18.10.26 Original   By: agent
+*/
+static BOOL IsSP3ResType(int resType)
+{
+   if(!strcmp(blTorsionStatsResnam[resType], "LEU") ||
+      !strcmp(blTorsionStatsResnam[resType], "VAL") ||
+      !strcmp(blTorsionStatsResnam[resType], "ILE"))
+      return(TRUE);
+   return(FALSE);
+}
+
+
+/************************************************************************/
+/*>void blInitTorsionStats(FALTORSIONSTATS *stats)
+   -----------------------------------------------
+*//**
+
+   \param[out]     *stats       Torsion statistics
+
+   Clears a set of torsion statistics ready for accumulation. tor1 and
+   tor2 are treated as circular; diff is not.
+
+-  18.10.26 Original   By: agent
+-  18.10.26 Torsion statistics are circular   By: agent
+*/
+void blInitTorsionStats(FALTORSIONSTATS *stats)
+{
+   int resType;
+
+   stats->nStructures = 0;
+   for(resType=0; resType<FAL_NRESTYPES; resType++)
+   {
+      stats->res[resType].nResidues = 0;
+      stats->res[resType].nSwapped  = 0;
+      InitAngleStats(&(stats->res[resType].tor1), TRUE);
+      InitAngleStats(&(stats->res[resType].tor2), TRUE);
+      InitAngleStats(&(stats->res[resType].diff), FALSE);
+   }
+}
+
+
+/************************************************************************/
+/*>BOOL blAccumulateTorsionStats(FALTORSIONSTATS *stats, PDB *pdb)
+   ---------------------------------------------------------------
+*//**
+
+   \param[in,out]  *stats       Torsion statistics
+   \param[in]      *pdb         PDB linked list
+   \return                      Success? (FALSE if out of memory)
+
+   Adds the tor1, tor2 and diff values reported by 
+   blPrintTorsionAtomLabels() for each residue to the statistics, 
+   together with whether blFixAtomLabels() would swap the residue.
+   Torsions are accumulated in the range -180...180 and diff in the 
+   range 0...360. Residues with missing atoms are skipped.
+
+-  18.10.26 Original   By: agent
+-  18.10.26 Uses the geometry kernel   By: agent
+-  18.10.26 Residues which cannot be swapped are not counted as
+            swapped   By: agent
+*/
+BOOL blAccumulateTorsionStats(FALTORSIONSTATS *stats, PDB *pdb)
+{
+   TORSIONSET *set;
+   int        i;
+
+   if((set = GatherTorsionSet(pdb, FALSE)) == NULL)
+      return(FALSE);
+
+   (*blGetGeomKernel())(set->n, set->maxN, set->coords, set->isSP3,
+                        set->tor1, set->tor2, set->swap);
+
+   for(i=0; i<set->n; i++)
+   {
+      FALRESSTATS *res = &(stats->res[set->resType[i]]);
+      
+      res->nResidues++;
+      if(set->swap[i] && (set->unpaired[i] == NULL))
+         res->nSwapped++;
+      AccumulateAngle(&(res->tor1), set->tor1[i], -180.0);
+      AccumulateAngle(&(res->tor2), set->tor2[i], -180.0);
+      AccumulateAngle(&(res->diff),
+                      CalcAngleDiff(set->tor1[i], set->tor2[i]), 0.0);
+   }
+   stats->nStructures++;
+
+   FreeTorsionSet(set);
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>int blTestGeomKernels(FILE *out, PDB *pdb)
+   ------------------------------------------
+*//**
+
+   \param[in]      *out         Output file pointer for the report
+   \param[in]      *pdb         PDB linked list
+   \return                      Number of swap decisions which differ
+                                from the reference (-1 if out of
+                                memory)
+
+   Runs every kernel variant supported by this CPU over a structure and
+   compares it with a reference calculated one residue at a time with
+   blPhi() and the original tests (the difference between the torsions
+   being outside 90...180 for SP3 atoms and NeedToSwapSP2Atoms() for
+   SP2 atoms). Reports, for each kernel, the number of residues where
+   the swap decision differs from the reference and the largest 
+   torsion difference.
+
+-  18.10.26 Original   By: agent
+-  18.10.26 Compares against blPhi() rather than the generic kernel
+            By: agent
+*/
+int blTestGeomKernels(FILE *out, PDB *pdb)
+{
+   TORSIONSET *set;
+   GEOMKERNEL *kernels;
+   REAL       *refTor1  = NULL,
+              *refTor2  = NULL;
+   BOOL       *refSwap  = NULL;
+   int        i, k,
+              nKernels,
+              nMismatch = 0;
+
+   if((set = GatherTorsionSet(pdb, FALSE)) == NULL)
+      return(-1);
+
+   if(((refTor1 = (REAL *)malloc((set->n+1) * sizeof(REAL))) == NULL) ||
+      ((refTor2 = (REAL *)malloc((set->n+1) * sizeof(REAL))) == NULL) ||
+      ((refSwap = (BOOL *)malloc((set->n+1) * sizeof(BOOL))) == NULL))
+   {
+      FREE(refTor1);
+      FREE(refTor2);
+      FreeTorsionSet(set);
+      return(-1);
+   }
+
+   for(i=0; i<set->n; i++)
+   {
+      PDB  *atom[5];
+      REAL diff;
+
+      FindTorsionAtoms(set->res[i], atom);
+      refTor1[i] = CalcTorsion(atom[0], atom[1], atom[2], atom[3], FALSE);
+      refTor2[i] = CalcTorsion(atom[0], atom[1], atom[2], atom[4], FALSE);
+      if(set->isSP3[i])
+      {
+         diff       = CalcAngleDiff(refTor1[i], refTor2[i]);
+         refSwap[i] = ((diff < 90) || (diff > 180));
+      }
+      else
+      {
+         refSwap[i] = NeedToSwapSP2Atoms(refTor1[i], refTor2[i]);
+      }
+   }
+
+   kernels = blGetGeomKernels(&nKernels);
+   for(k=0; k<nKernels; k++)
+   {
+      int  nDiffer = 0;
+      REAL maxDiff = 0.0;
+      
+      if(!kernels[k].supported)
+      {
+         fprintf(out, "%-8s not supported by this CPU\n",
+                 kernels[k].name);
+         continue;
+      }
+      
+      (*kernels[k].fn)(set->n, set->maxN, set->coords, set->isSP3,
+                       set->tor1, set->tor2, set->swap);
+      for(i=0; i<set->n; i++)
+      {
+         REAL d1, d2;
+
+         if(set->swap[i] != refSwap[i])
+            nDiffer++;
+
+         /* Torsions of +180 and -180 are the same                     */
+         d1 = fabs(set->tor1[i] - refTor1[i]);
+         d2 = fabs(set->tor2[i] - refTor2[i]);
+         maxDiff = MAX(maxDiff, MIN(d1, 360.0 - d1));
+         maxDiff = MAX(maxDiff, MIN(d2, 360.0 - d2));
+      }
+      fprintf(out, "%-8s %d residues, %d decisions differ, max torsion \
+difference %g\n",
+              kernels[k].name, set->n, nDiffer, maxDiff);
+      nMismatch += nDiffer;
+   }
+
+   free(refTor1);
+   free(refTor2);
+   free(refSwap);
+   FreeTorsionSet(set);
+   return(nMismatch);
+}
+
+
+/************************************************************************/
+/*>void blWriteTorsionStats(FILE *out, FALTORSIONSTATS *stats)
+   -----------------------------------------------------------
+*//**
+
+   \param[in]      *out         Output file pointer
+   \param[in]      *stats       Torsion statistics
+
+   Writes the statistics as JSON. For each residue type this gives the
+   number of residues and the number swapped and, for each of tor1, tor2
+   and diff, summary statistics and a histogram of FAL_NHISTBINS bins 
+   starting at -180 (torsions) or 0 (diff). For the torsions these are
+   the circular mean, circular standard deviation and mean resultant
+   length (r); for diff, which is a 0...360 range used for thresholds,
+   they are the mean, standard deviation, minimum and maximum.
+
+-  18.10.26 Original   By: agent
+-  18.10.26 Circular statistics for the torsions   By: agent
+*/
+void blWriteTorsionStats(FILE *out, FALTORSIONSTATS *stats)
+{
+   int resType;
+
+   fprintf(out, "{\n");
+   fprintf(out, "  \"structures\": %ld,\n", stats->nStructures);
+   fprintf(out, "  \"binwidth\": %.1f,\n", 360.0/FAL_NHISTBINS);
+   fprintf(out, "  \"residues\": {\n");
+   for(resType=0; resType<FAL_NRESTYPES; resType++)
+   {
+      FALRESSTATS *res = &(stats->res[resType]);
+      
+      fprintf(out, "    \"%s\": {\n", blTorsionStatsResnam[resType]);
+      fprintf(out, "      \"count\": %ld,\n", res->nResidues);
+      fprintf(out, "      \"swapped\": %ld,\n", res->nSwapped);
+      WriteAngleStats(out, "tor1", &(res->tor1), -180.0, FALSE);
+      WriteAngleStats(out, "tor2", &(res->tor2), -180.0, FALSE);
+      WriteAngleStats(out, "diff", &(res->diff),    0.0, TRUE);
+      fprintf(out, "    }%s\n", (resType < FAL_NRESTYPES-1) ? "," : "");
+   }
+   fprintf(out, "  }\n");
+   fprintf(out, "}\n");
+}
+
+
+/************************************************************************/
+/*>static TORSIONSET *GatherTorsionSet(PDB *pdb, BOOL keepIncomplete)
+   -------------------------------------------------------------------
+*//**
+
+   \param[in]      *pdb         PDB linked list
+   \param[in]      keepIncomplete  Include residues with missing atoms?
+   \return                      The residues to be handled (NULL if out
+                                of memory)
+
+   Collects the coordinates of the atoms defining the torsions for
+   every residue we handle into arrays for the geometry kernels. There
+   is one array (of maxN entries) for each coordinate so that the 
+   kernels can be vectorized. Residues with any of these atoms missing
+   are skipped unless keepIncomplete is set, in which case they are
+   included with zero coordinates and complete[] set to FALSE; the
+   kernel results for them are meaningless. unpaired[] is set for
+   residues which must not be swapped because a symmetrical atom has
+   no partner.
+
+-  18.10.26 Original   By: agent
+-  18.10.26 Added keepIncomplete   By: agent
+-  18.10.26 Added unpaired   By: agent
+*/
+static TORSIONSET *GatherTorsionSet(PDB *pdb, BOOL keepIncomplete)
+{
+   TORSIONSET *set;
+   PDB        *res,
+              *nextres;
+   int        nRes = 0;
+
+   for(res=pdb; res!=NULL; res=blFindNextResidue(res))
+      nRes++;
+
+   if((set = (TORSIONSET *)malloc(sizeof(TORSIONSET))) == NULL)
+      return(NULL);
+
+   /* +1 so that we never ask for zero bytes                           */
+   nRes++;
+   set->n        = 0;
+   set->maxN     = nRes;
+   set->res      = (PDB **)malloc(nRes * sizeof(PDB *));
+   set->nextres  = (PDB **)malloc(nRes * sizeof(PDB *));
+   set->unpaired = (PDB **)malloc(nRes * sizeof(PDB *));
+   set->coords   = (REAL *)malloc(nRes * GEOM_NCOORDS * sizeof(REAL));
+   set->tor1     = (REAL *)malloc(nRes * sizeof(REAL));
+   set->tor2     = (REAL *)malloc(nRes * sizeof(REAL));
+   set->isSP3    = (BOOL *)malloc(nRes * sizeof(BOOL));
+   set->swap     = (BOOL *)malloc(nRes * sizeof(BOOL));
+   set->resType  = (int  *)malloc(nRes * sizeof(int));
+   set->complete = (BOOL *)malloc(nRes * sizeof(BOOL));
+
+   if((set->res    == NULL) || (set->nextres  == NULL) ||
+      (set->coords == NULL) || (set->tor1     == NULL) ||
+      (set->tor2   == NULL) || (set->isSP3    == NULL) ||
+      (set->swap   == NULL) || (set->resType  == NULL) ||
+      (set->complete == NULL) || (set->unpaired == NULL))
+   {
+      FreeTorsionSet(set);
+      return(NULL);
+   }
+
+   for(res=pdb; res!=NULL; res=nextres)
+   {
+      PDB  *atom[5],
+           *pairs[MAXSWAPPAIRS][2];
+      REAL *c;
+      BOOL complete = TRUE;
+      int  resType, i,
+           stride = set->maxN;
+      
+      nextres = blFindNextResidue(res);
+      if((resType = FindTorsionAtoms(res, atom)) < 0)
+         continue;
+      for(i=0; i<5; i++)
+      {
+         if(atom[i] == NULL)
+            complete = FALSE;
+      }
+      if(!complete && !keepIncomplete)
+         continue;
+
+      c = set->coords + set->n;
+      for(i=0; i<5; i++)
+      {
+         c[(3*i)   * stride] = (complete ? atom[i]->x : 0.0);
+         c[(3*i+1) * stride] = (complete ? atom[i]->y : 0.0);
+         c[(3*i+2) * stride] = (complete ? atom[i]->z : 0.0);
+      }
+      set->res[set->n]      = res;
+      set->nextres[set->n]  = nextres;
+      set->resType[set->n]  = resType;
+      set->isSP3[set->n]    = IsSP3ResType(resType);
+      set->complete[set->n] = complete;
+      set->unpaired[set->n] = FindSwapAtoms(res, nextres, resType, pairs);
+      set->n++;
+   }
+
+   return(set);
+}
+
+
+/************************************************************************/
+/*>static void FreeTorsionSet(TORSIONSET *set)
+   -------------------------------------------
+*//**
+
+   \param[in]      *set         Residues from GatherTorsionSet()
+
+-  18.10.26 Original   By: agent
+*/
+static void FreeTorsionSet(TORSIONSET *set)
+{
+   FREE(set->res);
+   FREE(set->nextres);
+   FREE(set->unpaired);
+   FREE(set->coords);
+   FREE(set->tor1);
+   FREE(set->tor2);
+   FREE(set->isSP3);
+   FREE(set->swap);
+   FREE(set->resType);
+   FREE(set->complete);
+   free(set);
+}
+
+
+/************************************************************************/
+/*>static void InitAngleStats(FALANGLESTATS *stats, BOOL circular)
+   ----------------------------------------------------------------
+*//**
+
+   \param[out]     *stats       Angle statistics
+   \param[in]      circular     Report circular statistics?
+
+-  18.10.26 Original   By: agent
+-  18.10.26 Added circular   By: agent
+*/
+static void InitAngleStats(FALANGLESTATS *stats, BOOL circular)
+{
+   int i;
+   
+   stats->sum      = 0.0;
+   stats->sumSq    = 0.0;
+   stats->sumSin   = 0.0;
+   stats->sumCos   = 0.0;
+   stats->min      = FAL_ERROR_VALUE;
+   stats->max      = -FAL_ERROR_VALUE;
+   stats->circular = circular;
+   for(i=0; i<FAL_NHISTBINS; i++)
+      stats->hist[i] = 0;
+}
+
+
+/************************************************************************/
+/*>static void AccumulateAngle(FALANGLESTATS *stats, REAL angle, REAL low)
+   -----------------------------------------------------------------------
+*//**
+
+   \param[in,out]  *stats       Angle statistics
+   \param[in]      angle        Angle to add
+   \param[in]      low          Lower end of the 360 degree range into
+                                which the angle is put
+
+-  18.10.26 Original   By: agent
+*/
+static void AccumulateAngle(FALANGLESTATS *stats, REAL angle, REAL low)
+{
+   int bin;
+   
+   while(angle < low)
+      angle += 360.0;
+   while(angle >= low + 360.0)
+      angle -= 360.0;
+
+   stats->sum    += angle;
+   stats->sumSq  += angle * angle;
+   stats->sumSin += sin(angle * PI / 180.0);
+   stats->sumCos += cos(angle * PI / 180.0);
+   if(angle < stats->min)
+      stats->min = angle;
+   if(angle > stats->max)
+      stats->max = angle;
+
+   bin = (int)((angle - low) * FAL_NHISTBINS / 360.0);
+   if(bin >= FAL_NHISTBINS)
+      bin = FAL_NHISTBINS - 1;
+   stats->hist[bin]++;
+}
+
+
+/************************************************************************/
+/*>static void WriteAngleStats(FILE *out, char *name, 
+                               FALANGLESTATS *stats, REAL low, BOOL last)
+   ----------------------------------------------------------------------
+*//**
+
+   \param[in]      *out         Output file pointer
+   \param[in]      *name        Name of the angle
+   \param[in]      *stats       Angle statistics
+   \param[in]      low          Lower end of the histogram
+   \param[in]      last         Is this the last item in the residue?
+
+   Circular statistics are the mean direction, the circular standard
+   deviation sqrt(-2 ln r) and the mean resultant length r (1 if all
+   the angles are the same, near 0 if they are spread evenly), each
+   from the sums of the sines and cosines. The circular sd is null if
+   r is 0.
+
+-  18.10.26 Original   By: agent
+-  18.10.26 Writes circular statistics if requested   By: agent
+*/
+static void WriteAngleStats(FILE *out, char *name, FALANGLESTATS *stats,
+                            REAL low, BOOL last)
+{
+   long count = 0;
+   REAL mean  = 0.0,
+        sd    = 0.0;
+   int  i;
+
+   for(i=0; i<FAL_NHISTBINS; i++)
+      count += stats->hist[i];
+
+   fprintf(out, "      \"%s\": {\n", name);
+   if(stats->circular)
+   {
+      if(count)
+      {
+         REAL r = sqrt(stats->sumSin * stats->sumSin +
+                       stats->sumCos * stats->sumCos) / count;
+         
+         mean = atan2(stats->sumSin, stats->sumCos) * 180.0 / PI;
+         if(mean < low)
+            mean += 360.0;
+         if(r >= 1.0)
+            fprintf(out, "        \"mean\": %.3f, \"sd\": %.3f, \
+\"r\": %.3f,\n", mean, 0.0, 1.0);
+         else if(r > 0.0)
+            fprintf(out, "        \"mean\": %.3f, \"sd\": %.3f, \
+\"r\": %.3f,\n", mean, sqrt(-2.0 * log(r)) * 180.0 / PI, r);
+         else
+            fprintf(out, "        \"mean\": null, \"sd\": null, \
+\"r\": %.3f,\n", 0.0);
+      }
+      else
+      {
+         fprintf(out, "        \"mean\": null, \"sd\": null, \
+\"r\": null,\n");
+      }
+   }
+   else if(count)
+   {
+      mean = stats->sum / count;
+      if(count > 1)
+      {
+         sd = (stats->sumSq - count * mean * mean) / (count - 1);
+         sd = (sd > 0.0) ? sqrt(sd) : 0.0;
+      }
+      fprintf(out, "        \"mean\": %.3f, \"sd\": %.3f, \
+\"min\": %.3f, \"max\": %.3f,\n", mean, sd, stats->min, stats->max);
+   }
+   else
+   {
+      fprintf(out, "        \"mean\": null, \"sd\": null, \
+\"min\": null, \"max\": null,\n");
+   }
+   fprintf(out, "        \"low\": %.1f,\n", low);
+   fprintf(out, "        \"hist\": [");
+   for(i=0; i<FAL_NHISTBINS; i++)
+      fprintf(out, "%s%ld", (i ? ", " : ""), stats->hist[i]);
+   fprintf(out, "]\n");
+   fprintf(out, "      }%s\n", last ? "" : ",");
+}
@@ -1,7 +1,39 @@
 #ifndef _FixAtomLabels_h_
 #define _FixAtomLabels_h_ 1
 
-void blFixAtomLabels(PDB *pdb, int verbose);
+#ifdef ILE
+#  define FAL_NRESTYPES 8
+#else
+#  define FAL_NRESTYPES 7
+#endif
+#define FAL_NHISTBINS 36
+
+typedef struct
+{
+   REAL sum, sumSq, sumSin, sumCos, min, max;
+   long hist[FAL_NHISTBINS];
+   BOOL circular;
+}  FALANGLESTATS;
+
+typedef struct
+{
+   long          nResidues, nSwapped;
+   FALANGLESTATS tor1, tor2, diff;
+}  FALRESSTATS;
+
+typedef struct
+{
+   long        nStructures;
+   FALRESSTATS res[FAL_NRESTYPES];
+}  FALTORSIONSTATS;
+
+extern char *blTorsionStatsResnam[FAL_NRESTYPES];
+
+int  blFixAtomLabels(PDB *pdb, int verbose);
 void blPrintTorsionAtomLabels(FILE *out, PDB *pdb);
+void blInitTorsionStats(FALTORSIONSTATS *stats);
+BOOL blAccumulateTorsionStats(FALTORSIONSTATS *stats, PDB *pdb);
+void blWriteTorsionStats(FILE *out, FALTORSIONSTATS *stats);
+int  blTestGeomKernels(FILE *out, PDB *pdb);
 
 #endif
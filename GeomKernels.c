@@ -0,0 +1,177 @@
+/************************************************************************/
+/**
+
+   Program:
+   \file       GeomKernels.c
+
+   \version    V1.0
+   \date       18.10.26
+   \brief      Geometry and decision kernels for fixing symmetrical atom
+               labels
+
+   \copyright  (c) agent 2026
+   \author     agent
+   \par
+               agent@local
+
+**************************************************************************
+
+   This program is not in the public domain, but it may be copied
+   according to the conditions laid out in the accompanying file
+   COPYING.DOC
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified.
+
+   The code may not be sold commercially or included as part of a
+   commercial product except as described in the file COPYING.DOC.
+
+**************************************************************************
+
+   Description:
+   ============
+   This file is compiled several times with different instruction set
+   flags, defining KERNEL_ISA to the name of the variant each time
+   (see the Makefile). KernelDispatch.c picks the best variant for the
+   CPU at run time.
+
+   It must be compiled with -ffp-contract=off so that no variant fuses
+   multiplies and adds. All variants then round identically and make
+   exactly the same swap decisions. -fno-math-errno is also needed for
+   the sqrt() to be vectorized.
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0    18.10.26   Original   By: agent
+
+*************************************************************************/
+/* Includes
+*/
+#include <math.h>
+
+#include "bioplib/SysDefs.h"
+#include "bioplib/macros.h"
+#include "GeomKernels.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#ifndef KERNEL_ISA
+#  define KERNEL_ISA generic
+#endif
+#define KERNEL_NAME2(isa) blGeomKernel_ ## isa
+#define KERNEL_NAME(isa)  KERNEL_NAME2(isa)
+#define KERNEL_BLOCK      64   /* Residues handled per block            */
+#define C(k,i)            c[(k)*stride + (i)]
+
+/************************************************************************/
+/*>void blGeomKernel_<isa>(int n, int stride, REAL *coords,
+                           BOOL *isSP3, REAL *tor1, REAL *tor2,
+                           BOOL *swap)
+   ---------------------------------------------------------------------
+*//**
+
+   \param[in]      n            Number of residues
+   \param[in]      stride       Spacing of the coordinate arrays
+   \param[in]      *coords      GEOM_NCOORDS arrays of coordinates
+                                (x,y,z of atoms 0-2 common to both
+                                torsions, then of the two symmetrical
+                                atoms). Coordinate k of residue i is at
+                                coords[k*stride + i]
+   \param[in]      *isSP3       Are the symmetrical atoms SP3?
+   \param[out]     *tor1        Torsion (degrees) to the first atom
+   \param[out]     *tor2        Torsion (degrees) to the second atom
+   \param[out]     *swap        Do the labels need swapping?
+
+   For SP3 atoms (LEU, VAL) the labels are swapped unless the angle
+   going from atom 1 to atom 2 is between 90 and 180. For SP2 atoms
+   they are swapped if atom 1 is further from a torsion of zero than
+   atom 2.
+
+   Residues are handled in blocks of KERNEL_BLOCK. The vector algebra
+   for a block is done in one loop which the compiler can vectorize
+   for the instruction set, leaving only the atan2() calls scalar.
+   The torsions use the same sign convention as blPhi().
+
+-  18.10.26 Original
+*/
+void KERNEL_NAME(KERNEL_ISA)(int n, int stride, REAL *coords,
+                             BOOL *isSP3, REAL *tor1, REAL *tor2,
+                             BOOL *swap)
+{
+   REAL x1[KERNEL_BLOCK], y1[KERNEL_BLOCK],
+        x2[KERNEL_BLOCK], y2[KERNEL_BLOCK];
+   int  start, i;
+
+   for(start=0; start<n; start+=KERNEL_BLOCK)
+   {
+      int  nBlock = MIN(KERNEL_BLOCK, n-start);
+      REAL *c     = coords + start;
+      
+      /* The first three atoms are shared by both torsions, so the
+         normal to the plane they define (n1), and the third axis of
+         the frame it defines with the bond 2-3 (m), are calculated
+         once. Each torsion is then -atan2(y,x) where x and y are the
+         projections of the normal to the plane of atoms 2, 3 and the
+         symmetrical atom onto n1 and m.
+      */
+      for(i=0; i<nBlock; i++)
+      {
+         REAL b1x, b1y, b1z, b2x, b2y, b2z, b3x, b3y, b3z,
+              n1x, n1y, n1z, n2x, n2y, n2z, mx, my, mz, b2;
+
+         b1x = C(3,i)-C(0,i);  b1y = C(4,i)-C(1,i);  b1z = C(5,i)-C(2,i);
+         b2x = C(6,i)-C(3,i);  b2y = C(7,i)-C(4,i);  b2z = C(8,i)-C(5,i);
+         
+         n1x = b1y*b2z - b1z*b2y;
+         n1y = b1z*b2x - b1x*b2z;
+         n1z = b1x*b2y - b1y*b2x;
+         b2  = sqrt(b2x*b2x + b2y*b2y + b2z*b2z);
+         mx  = (n1y*b2z - n1z*b2y) / b2;
+         my  = (n1z*b2x - n1x*b2z) / b2;
+         mz  = (n1x*b2y - n1y*b2x) / b2;
+
+         /* First symmetrical atom                                     */
+         b3x = C(9,i)-C(6,i);  b3y = C(10,i)-C(7,i); b3z = C(11,i)-C(8,i);
+         n2x = b2y*b3z - b2z*b3y;
+         n2y = b2z*b3x - b2x*b3z;
+         n2z = b2x*b3y - b2y*b3x;
+         x1[i] = n1x*n2x + n1y*n2y + n1z*n2z;
+         y1[i] = mx*n2x  + my*n2y  + mz*n2z;
+
+         /* Second symmetrical atom                                    */
+         b3x = C(12,i)-C(6,i); b3y = C(13,i)-C(7,i); b3z = C(14,i)-C(8,i);
+         n2x = b2y*b3z - b2z*b3y;
+         n2y = b2z*b3x - b2x*b3z;
+         n2z = b2x*b3y - b2y*b3x;
+         x2[i] = n1x*n2x + n1y*n2y + n1z*n2z;
+         y2[i] = mx*n2x  + my*n2y  + mz*n2z;
+      }
+      
+      for(i=0; i<nBlock; i++)
+      {
+         tor1[start+i] = -atan2(y1[i], x1[i]) * 180.0 / PI;
+         tor2[start+i] = -atan2(y2[i], x2[i]) * 180.0 / PI;
+      }
+   }
+
+   /* Written without branches so that it vectorizes                   */
+   for(i=0; i<n; i++)
+   {
+      REAL diff = tor2[i] - tor1[i];
+      BOOL sp3Swap, sp2Swap;
+
+      /* Torsions are -180...180 so one step puts this in 0...360      */
+      diff   += ((diff < 0.0) ? 360.0 : 0.0);
+      sp3Swap = ((diff < 90.0) | (diff > 180.0));
+      sp2Swap = (fabs(tor1[i]) > fabs(tor2[i]));
+      swap[i] = ((isSP3[i] != 0) & sp3Swap) | ((isSP3[i] == 0) & sp2Swap);
+   }
+}
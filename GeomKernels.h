@@ -0,0 +1,35 @@
+#ifndef _GeomKernels_h_
+#define _GeomKernels_h_ 1
+
+/* Number of coordinate arrays passed to the kernels: x,y,z for each of
+   the 5 atoms defining the two torsions
+*/
+#define GEOM_NCOORDS 15
+
+typedef void (*GEOMKERNELFN)(int n, int stride, REAL *coords,
+                             BOOL *isSP3, REAL *tor1, REAL *tor2,
+                             BOOL *swap);
+
+typedef struct
+{
+   char         *name;
+   GEOMKERNELFN fn;
+   BOOL         supported;
+}  GEOMKERNEL;
+
+void blGeomKernel_generic(int n, int stride, REAL *coords,
+                          BOOL *isSP3, REAL *tor1, REAL *tor2,
+                          BOOL *swap);
+void blGeomKernel_avx2(int n, int stride, REAL *coords,
+                       BOOL *isSP3, REAL *tor1, REAL *tor2,
+                       BOOL *swap);
+void blGeomKernel_avx512(int n, int stride, REAL *coords,
+                         BOOL *isSP3, REAL *tor1, REAL *tor2,
+                         BOOL *swap);
+
+BOOL         blSelectGeomKernel(char *name);
+GEOMKERNELFN blGetGeomKernel(void);
+char         *blGetGeomKernelName(void);
+GEOMKERNEL   *blGetGeomKernels(int *nKernels);
+
+#endif
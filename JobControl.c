@@ -0,0 +1,608 @@
+/************************************************************************/
+/**
+
+   Program:
+   \file       JobControl.c
+
+   \version    V1.4
+   \date       18.10.26
+   \brief      Manifest, checkpoint and shard handling for restartable
+               job runs
+
+   \copyright  (c) agent 2026
+   \author     agent
+   \par
+               agent@local
+
+**************************************************************************
+
+   This program is not in the public domain, but it may be copied
+   according to the conditions laid out in the accompanying file
+   COPYING.DOC
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified.
+
+   The code may not be sold commercially or included as part of a
+   commercial product except as described in the file COPYING.DOC.
+
+**************************************************************************
+
+   Description:
+   ============
+   A job is driven by a manifest file listing one input file per line,
+   optionally followed by whitespace and an output file. Completed
+   inputs are recorded in an append-only checkpoint log, one record per
+   line:
+
+      hash<TAB>mode<TAB>nswaps<TAB>infile<TAB>outfile
+
+   where hash is a 64-bit FNV-1a hash of the input file contents in hex
+   and mode is "fix" or "report" (-r). Records are indexed by output
+   file and a later record for an output file supersedes any earlier
+   one, since the output has been overwritten. An input is treated as
+   complete only if the latest record for its output file names the
+   same input with the same hash and mode, and the output file still
+   exists. Changed inputs, a run in the other mode (including one that
+   overwrote the output in between), a run writing to a different
+   output directory, or a deleted output all cause it to be processed
+   again.
+
+   The manifest is divided into shards. A process claims a shard by
+   taking an exclusive fcntl() lock on the byte at offset shard in a
+   single lock file, named after the checkpoint log with .lock added.
+   The lock file stays empty; locks beyond the end of a file are
+   allowed. The kernel drops the locks if the process dies, so a shard
+   abandoned by a crashed process can be claimed again. The lock file
+   may be deleted once no process is running the job.
+   Records are appended to the log with a single write() under an
+   exclusive lock so that several processes may share one log.
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0    18.10.26   Original   By: agent
+   V1.1    18.10.26   HashFile() replaced by HashBuffer()   By: agent
+   V1.2    18.10.26   Records include the mode and output file, which
+                      are part of the completion key   By: agent
+   V1.3    18.10.26   The latest record for an output file supersedes
+                      earlier ones and the output must still exist
+                      By: agent
+   V1.4    18.10.26   Shards are claimed with byte-range locks on one
+                      lock file rather than one lock file per shard
+                      By: agent
+
+*************************************************************************/
+/* Includes
+*/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "bioplib/SysDefs.h"
+#include "bioplib/macros.h"
+#include "JobControl.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#define MAXBUFF        160
+#define MAXLINE        (4*MAXBUFF)
+#define CKPT_HASHSIZE  65537
+#define FNV_OFFSET     0xcbf29ce484222325ULL
+#define FNV_PRIME      0x100000001b3ULL
+#define CKPT_MODE(reportOnly) ((reportOnly) ? "report" : "fix")
+
+/************************************************************************/
+/* Globals
+*/
+
+/************************************************************************/
+/* Prototypes
+*/
+static uint64_t HashString(char *string);
+static void AddCheckpointRecord(CHECKPOINT *ckpt, char *line);
+
+/************************************************************************/
+/*>MANIFESTENTRY *ReadManifest(char *filename, int *nEntries)
+   ----------------------------------------------------------
+*//**
+
+   \param[in]      *filename    Manifest filename
+   \param[out]     *nEntries    Number of entries read
+   \return                      Array of entries (NULL on error)
+
+   Reads a manifest file. Blank lines and lines starting with a # are
+   ignored. Output files not given in the manifest are left as NULL.
+
+-  18.10.26 Original
+*/
+MANIFESTENTRY *ReadManifest(char *filename, int *nEntries)
+{
+   FILE          *fp;
+   MANIFESTENTRY *manifest = NULL;
+   int           maxEntries = 0;
+   char          buffer[MAXLINE];
+
+   *nEntries = 0;
+
+   if((fp = fopen(filename, "r")) == NULL)
+      return(NULL);
+
+   while(fgets(buffer, MAXLINE, fp))
+   {
+      char *infile, *outfile;
+
+      if((infile = strtok(buffer, " \t\r\n")) == NULL || infile[0] == '#')
+         continue;
+      outfile = strtok(NULL, " \t\r\n");
+
+      if(*nEntries == maxEntries)
+      {
+         MANIFESTENTRY *tmp;
+         maxEntries = (maxEntries ? 2*maxEntries : 1024);
+         if((tmp = realloc(manifest, maxEntries * sizeof(MANIFESTENTRY)))
+            == NULL)
+         {
+            FreeManifest(manifest, *nEntries);
+            fclose(fp);
+            return(NULL);
+         }
+         manifest = tmp;
+      }
+
+      manifest[*nEntries].infile  = strdup(infile);
+      manifest[*nEntries].outfile = (outfile ? strdup(outfile) : NULL);
+      (*nEntries)++;
+   }
+
+   fclose(fp);
+   return(manifest);
+}
+
+
+/************************************************************************/
+/*>void FreeManifest(MANIFESTENTRY *manifest, int nEntries)
+   --------------------------------------------------------
+*//**
+
+   \param[in]      *manifest    Manifest entries
+   \param[in]      nEntries     Number of entries
+
+   Frees a manifest read by ReadManifest()
+
+-  18.10.26 Original
+*/
+void FreeManifest(MANIFESTENTRY *manifest, int nEntries)
+{
+   int i;
+
+   if(manifest == NULL)
+      return;
+
+   for(i=0; i<nEntries; i++)
+   {
+      free(manifest[i].infile);
+      if(manifest[i].outfile != NULL)
+         free(manifest[i].outfile);
+   }
+   free(manifest);
+}
+
+
+/************************************************************************/
+/*>CHECKPOINT *OpenCheckpoint(char *filename)
+   ------------------------------------------
+*//**
+
+   \param[in]      *filename    Checkpoint log filename
+   \return                      Checkpoint (NULL on error)
+
+   Opens (creating if needed) a checkpoint log and reads the records
+   already in it. The shard lock file is opened (and created if needed)
+   as well.
+
+-  18.10.26 Original
+-  18.10.26 Opens the shard lock file   By: agent
+*/
+CHECKPOINT *OpenCheckpoint(char *filename)
+{
+   CHECKPOINT *ckpt;
+   char       lockFile[MAXLINE];
+
+   if((ckpt = (CHECKPOINT *)malloc(sizeof(CHECKPOINT))) == NULL)
+      return(NULL);
+   if((ckpt->table = (CKPTREC **)calloc(CKPT_HASHSIZE, sizeof(CKPTREC *)))
+      == NULL)
+   {
+      free(ckpt);
+      return(NULL);
+   }
+   ckpt->offset = 0;
+   ckpt->lockFd = -1;
+
+   if((ckpt->fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0644)) < 0)
+   {
+      free(ckpt->table);
+      free(ckpt);
+      return(NULL);
+   }
+
+   if((snprintf(lockFile, MAXLINE, "%s.lock", filename) >= MAXLINE) ||
+      ((ckpt->lockFd = open(lockFile, O_RDWR | O_CREAT, 0644)) < 0))
+   {
+      CloseCheckpoint(ckpt);
+      return(NULL);
+   }
+
+   if(!ReadCheckpoint(ckpt))
+   {
+      CloseCheckpoint(ckpt);
+      return(NULL);
+   }
+
+   return(ckpt);
+}
+
+
+/************************************************************************/
+/*>BOOL ReadCheckpoint(CHECKPOINT *ckpt)
+   -------------------------------------
+*//**
+
+   \param[in,out]  *ckpt        Checkpoint
+   \return                      Success?
+
+   Reads any records added to the checkpoint log since it was last read.
+   A trailing partial line (left by a process killed part way through a
+   write) is not consumed. Malformed lines are ignored.
+
+-  18.10.26 Original
+*/
+BOOL ReadCheckpoint(CHECKPOINT *ckpt)
+{
+   char    buffer[MAXLINE],
+           line[MAXLINE];
+   int     lineLen = 0;
+   ssize_t nRead;
+   off_t   offset;
+
+   if(flock(ckpt->fd, LOCK_SH))
+      return(FALSE);
+
+   offset = ckpt->offset;
+   while((nRead = pread(ckpt->fd, buffer, MAXLINE, offset)) > 0)
+   {
+      ssize_t i;
+      for(i=0; i<nRead; i++)
+      {
+         if(buffer[i] == '\n')
+         {
+            line[lineLen] = '\0';
+            AddCheckpointRecord(ckpt, line);
+            ckpt->offset = offset + i + 1;
+            lineLen = 0;
+         }
+         else if(lineLen < MAXLINE-1)
+         {
+            line[lineLen++] = buffer[i];
+         }
+      }
+      offset += nRead;
+   }
+
+   flock(ckpt->fd, LOCK_UN);
+   return(nRead == 0);
+}
+
+
+/************************************************************************/
+/*>BOOL IsCompleted(CHECKPOINT *ckpt, char *infile, char *outfile,
+                    BOOL reportOnly, uint64_t hash)
+   ----------------------------------------------------------------
+*//**
+
+   \param[in]      *ckpt        Checkpoint
+   \param[in]      *infile      Input filename
+   \param[in]      *outfile     Output filename
+   \param[in]      reportOnly   Is this a report (-r) run?
+   \param[in]      hash         Hash of the input file contents
+   \return                      Has this input already been processed
+                                to this output in this mode?
+
+   The output's latest record must match and the output must still
+   exist, so an output overwritten by a run in the other mode, or
+   deleted since, is written again.
+
+-  18.10.26 Original
+-  18.10.26 Added outfile and reportOnly to the key
+-  18.10.26 Looks up the output's latest record and checks the output
+            exists   By: agent
+*/
+BOOL IsCompleted(CHECKPOINT *ckpt, char *infile, char *outfile,
+                 BOOL reportOnly, uint64_t hash)
+{
+   CKPTREC     *rec;
+   struct stat st;
+
+   for(rec = ckpt->table[HashString(outfile) % CKPT_HASHSIZE];
+       rec != NULL;
+       rec = rec->next)
+   {
+      if(!strcmp(rec->outfile, outfile))
+      {
+         return((rec->hash == hash)                   &&
+                (rec->reportOnly == (reportOnly != 0)) &&
+                (rec->infile != NULL)                 &&
+                !strcmp(rec->infile, infile)          &&
+                (stat(outfile, &st) == 0));
+      }
+   }
+   return(FALSE);
+}
+
+
+/************************************************************************/
+/*>BOOL AppendCheckpoint(CHECKPOINT *ckpt, char *infile, char *outfile,
+                         BOOL reportOnly, uint64_t hash, int nSwaps)
+   ---------------------------------------------------------------------
+*//**
+
+   \param[in,out]  *ckpt        Checkpoint
+   \param[in]      *infile      Input filename
+   \param[in]      *outfile     Output filename
+   \param[in]      reportOnly   Is this a report (-r) run?
+   \param[in]      hash         Hash of the input file contents
+   \param[in]      nSwaps       Number of residues swapped
+   \return                      Success?
+
+   Appends a completion record to the log and syncs it to disk.
+
+-  18.10.26 Original
+-  18.10.26 Records the mode
+*/
+BOOL AppendCheckpoint(CHECKPOINT *ckpt, char *infile, char *outfile,
+                      BOOL reportOnly, uint64_t hash, int nSwaps)
+{
+   char line[MAXLINE];
+   int  len;
+   BOOL ok;
+
+   len = snprintf(line, MAXLINE, "%016llx\t%s\t%d\t%s\t%s\n",
+                  (unsigned long long)hash, CKPT_MODE(reportOnly), nSwaps,
+                  infile, outfile);
+   if(len >= MAXLINE)
+      return(FALSE);
+
+   if(flock(ckpt->fd, LOCK_EX))
+      return(FALSE);
+   ok = ((write(ckpt->fd, line, len) == len) && !fsync(ckpt->fd));
+   flock(ckpt->fd, LOCK_UN);
+
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>void CloseCheckpoint(CHECKPOINT *ckpt)
+   --------------------------------------
+*//**
+
+   \param[in]      *ckpt        Checkpoint
+
+   Closes the checkpoint log and frees the records
+
+-  18.10.26 Original
+*/
+void CloseCheckpoint(CHECKPOINT *ckpt)
+{
+   int i;
+
+   for(i=0; i<CKPT_HASHSIZE; i++)
+   {
+      CKPTREC *rec, *next;
+      for(rec=ckpt->table[i]; rec!=NULL; rec=next)
+      {
+         next = rec->next;
+         free(rec->infile);
+         free(rec->outfile);
+         free(rec);
+      }
+   }
+   close(ckpt->fd);
+   if(ckpt->lockFd >= 0)
+      close(ckpt->lockFd);
+   free(ckpt->table);
+   free(ckpt);
+}
+
+
+/************************************************************************/
+/*>BOOL ClaimShard(CHECKPOINT *ckpt, int shard)
+   ---------------------------------------------
+*//**
+
+   \param[in]      *ckpt        Checkpoint
+   \param[in]      shard        Shard number
+   \return                      Was the shard claimed? FALSE if it is
+                                held by another process or on error
+
+   Tries to take the lock on a shard without waiting. fcntl() locks
+   belong to the process, so a shard is never held against the process
+   that claimed it, and all are dropped if any descriptor for the lock
+   file is closed; only ckpt->lockFd is ever opened on it.
+
+-  18.10.26 Original
+-  18.10.26 Locks a byte of the single lock file rather than a file per
+            shard   By: agent
+*/
+BOOL ClaimShard(CHECKPOINT *ckpt, int shard)
+{
+   struct flock lock;
+
+   memset(&lock, 0, sizeof(lock));
+   lock.l_type   = F_WRLCK;
+   lock.l_whence = SEEK_SET;
+   lock.l_start  = (off_t)shard;
+   lock.l_len    = 1;
+
+   return(fcntl(ckpt->lockFd, F_SETLK, &lock) == 0);
+}
+
+
+/************************************************************************/
+/*>void ReleaseShard(CHECKPOINT *ckpt, int shard)
+   ----------------------------------------------
+*//**
+
+   \param[in]      *ckpt        Checkpoint
+   \param[in]      shard        Shard number from ClaimShard()
+
+-  18.10.26 Original
+-  18.10.26 Unlocks a byte of the single lock file   By: agent
+*/
+void ReleaseShard(CHECKPOINT *ckpt, int shard)
+{
+   struct flock lock;
+
+   memset(&lock, 0, sizeof(lock));
+   lock.l_type   = F_UNLCK;
+   lock.l_whence = SEEK_SET;
+   lock.l_start  = (off_t)shard;
+   lock.l_len    = 1;
+
+   fcntl(ckpt->lockFd, F_SETLK, &lock);
+}
+
+
+/************************************************************************/
+/*>uint64_t HashBuffer(char *data, size_t size)
+   ---------------------------------------------
+*//**
+
+   \param[in]      *data        Data to hash (normally a whole file)
+   \param[in]      size         Size of the data
+   \return                      64-bit FNV-1a hash of the data
+
+-  18.10.26 Original
+-  18.10.26 Hashes a buffer rather than reading the file itself, since
+            input files are now read whole
+*/
+uint64_t HashBuffer(char *data, size_t size)
+{
+   uint64_t hash = FNV_OFFSET;
+   size_t   i;
+
+   for(i=0; i<size; i++)
+   {
+      hash ^= (unsigned char)data[i];
+      hash *= FNV_PRIME;
+   }
+   return(hash);
+}
+
+
+/************************************************************************/
+/*>static uint64_t HashString(char *string)
+   ----------------------------------------
+*//**
+
+   \param[in]      *string      String to hash
+   \return                      64-bit FNV-1a hash of the string
+
+-  18.10.26 Original
+*/
+static uint64_t HashString(char *string)
+{
+   uint64_t hash = FNV_OFFSET;
+
+   for(; *string; string++)
+   {
+      hash ^= (unsigned char)*string;
+      hash *= FNV_PRIME;
+   }
+   return(hash);
+}
+
+
+/************************************************************************/
+/*>static void AddCheckpointRecord(CHECKPOINT *ckpt, char *line)
+   -------------------------------------------------------------
+*//**
+
+   \param[in,out]  *ckpt        Checkpoint
+   \param[in]      *line        A line from the checkpoint log
+
+   Parses a checkpoint log line and adds it to the hash table, which
+   is indexed by output file. A record for an output file that is
+   already in the table replaces it, since the log is read in the order
+   it was written and the later run has overwritten the output. Lines
+   in the older format without a mode are malformed, so those inputs
+   are simply processed again.
+
+-  18.10.26 Original
+-  18.10.26 Reads the mode and output file
+-  18.10.26 Indexed by output file and supersedes earlier records for
+            the same output   By: agent
+*/
+static void AddCheckpointRecord(CHECKPOINT *ckpt, char *line)
+{
+   char     *hashStr, *mode, *nSwapsStr, *infile, *outfile, *end;
+   CKPTREC  *rec;
+   uint64_t hash;
+   int      bucket;
+
+   if(((hashStr   = strtok(line, "\t")) == NULL) ||
+      ((mode      = strtok(NULL, "\t")) == NULL) ||
+      ((nSwapsStr = strtok(NULL, "\t")) == NULL) ||
+      ((infile    = strtok(NULL, "\t")) == NULL) ||
+      ((outfile   = strtok(NULL, "\t")) == NULL))
+      return;
+   if(strcmp(mode, CKPT_MODE(TRUE)) && strcmp(mode, CKPT_MODE(FALSE)))
+      return;
+
+   errno = 0;
+   hash  = (uint64_t)strtoull(hashStr, &end, 16);
+   if(errno || *end)
+      return;
+
+   bucket = HashString(outfile) % CKPT_HASHSIZE;
+   for(rec = ckpt->table[bucket]; rec != NULL; rec = rec->next)
+   {
+      if(!strcmp(rec->outfile, outfile))
+         break;
+   }
+
+   if(rec == NULL)
+   {
+      if((rec = (CKPTREC *)malloc(sizeof(CKPTREC))) == NULL)
+         return;
+      if((rec->outfile = strdup(outfile)) == NULL)
+      {
+         free(rec);
+         return;
+      }
+      rec->infile = NULL;
+      rec->next   = ckpt->table[bucket];
+      ckpt->table[bucket] = rec;
+   }
+
+   /* Replace the input of any earlier record for this output; if we
+      run out of memory the record is left unmatchable so the input is
+      just processed again
+   */
+   FREE(rec->infile);
+   rec->infile     = strdup(infile);
+   rec->hash       = hash;
+   rec->reportOnly = !strcmp(mode, CKPT_MODE(TRUE));
+}
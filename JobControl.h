@@ -0,0 +1,43 @@
+#ifndef _JobControl_h_
+#define _JobControl_h_ 1
+
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct _ckptrec
+{
+   struct _ckptrec *next;
+   char            *infile,
+                   *outfile;
+   uint64_t        hash;
+   BOOL            reportOnly;
+}  CKPTREC;
+
+typedef struct
+{
+   CKPTREC **table;
+   off_t   offset;
+   int     fd,
+           lockFd;
+}  CHECKPOINT;
+
+typedef struct
+{
+   char *infile,
+        *outfile;
+}  MANIFESTENTRY;
+
+MANIFESTENTRY *ReadManifest(char *filename, int *nEntries);
+void FreeManifest(MANIFESTENTRY *manifest, int nEntries);
+CHECKPOINT *OpenCheckpoint(char *filename);
+BOOL ReadCheckpoint(CHECKPOINT *ckpt);
+BOOL IsCompleted(CHECKPOINT *ckpt, char *infile, char *outfile,
+                 BOOL reportOnly, uint64_t hash);
+BOOL AppendCheckpoint(CHECKPOINT *ckpt, char *infile, char *outfile,
+                      BOOL reportOnly, uint64_t hash, int nSwaps);
+void CloseCheckpoint(CHECKPOINT *ckpt);
+BOOL ClaimShard(CHECKPOINT *ckpt, int shard);
+void ReleaseShard(CHECKPOINT *ckpt, int shard);
+uint64_t HashBuffer(char *data, size_t size);
+
+#endif
@@ -0,0 +1,203 @@
+/************************************************************************/
+/**
+
+   Program:
+   \file       KernelDispatch.c
+
+   \version    V1.1
+   \date       18.10.26
+   \brief      Run-time selection of the geometry kernels
+
+   \copyright  (c) agent 2026
+   \author     agent
+   \par
+               agent@local
+
+**************************************************************************
+
+   This program is not in the public domain, but it may be copied
+   according to the conditions laid out in the accompanying file
+   COPYING.DOC
+
+   The code may be modified as required, but any modifications must be
+   documented so that the person responsible can be identified.
+
+   The code may not be sold commercially or included as part of a
+   commercial product except as described in the file COPYING.DOC.
+
+**************************************************************************
+
+   Description:
+   ============
+   Keeps the table of kernel variants built from GeomKernels.c. The
+   CPU is checked once to see which variants it can run. Unless one is
+   selected by name, the first supported variant in the table is used.
+
+   The AVX variants are only built on x86, where the Makefile defines
+   GEOM_X86_KERNELS. Elsewhere the table holds only the generic kernel.
+
+**************************************************************************
+
+   Usage:
+   ======
+
+**************************************************************************
+
+   Revision History:
+   =================
+   V1.0    18.10.26   Original   By: agent
+   V1.1    18.10.26   AVX variants only included on x86   By: agent
+
+*************************************************************************/
+/* Includes
+*/
+#include <string.h>
+
+#include "bioplib/SysDefs.h"
+#include "GeomKernels.h"
+
+/************************************************************************/
+/* Defines and macros
+*/
+#if defined(GEOM_X86_KERNELS) && defined(__GNUC__)
+#  define CPU_SUPPORTS(isa) __builtin_cpu_supports(isa)
+#else
+#  define CPU_SUPPORTS(isa) 0
+#endif
+
+/************************************************************************/
+/* Globals
+*/
+/* Best first. The generic variant must be last                         */
+static GEOMKERNEL sKernels[] =
+{
+#ifdef GEOM_X86_KERNELS
+   {"avx512",  blGeomKernel_avx512,  FALSE},
+   {"avx2",    blGeomKernel_avx2,    FALSE},
+#endif
+   {"generic", blGeomKernel_generic, TRUE }
+};
+#define NKERNELS (int)(sizeof(sKernels)/sizeof(GEOMKERNEL))
+
+static GEOMKERNEL *sCurrentKernel = NULL;
+static BOOL       sCPUChecked    = FALSE;
+
+/************************************************************************/
+/* Prototypes
+*/
+static void CheckCPU(void);
+
+/************************************************************************/
+/*>BOOL blSelectGeomKernel(char *name)
+   -----------------------------------
+*//**
+
+   \param[in]      *name        Kernel variant name, or NULL or "auto"
+                                to pick the best one for this CPU
+   \return                      Success? (FALSE if the variant is
+                                unknown or not supported by this CPU)
+
+-  18.10.26 Original
+*/
+BOOL blSelectGeomKernel(char *name)
+{
+   int i;
+
+   CheckCPU();
+
+   for(i=0; i<NKERNELS; i++)
+   {
+      if(((name == NULL) || !strcmp(name, "auto") ||
+          !strcmp(name, sKernels[i].name)) &&
+         sKernels[i].supported)
+      {
+         sCurrentKernel = &(sKernels[i]);
+         return(TRUE);
+      }
+   }
+   return(FALSE);
+}
+
+
+/************************************************************************/
+/*>GEOMKERNELFN blGetGeomKernel(void)
+   ----------------------------------
+*//**
+
+   \return                      The selected kernel, choosing the best
+                                one for this CPU if none has been
+                                selected
+
+-  18.10.26 Original
+*/
+GEOMKERNELFN blGetGeomKernel(void)
+{
+   if(sCurrentKernel == NULL)
+      blSelectGeomKernel(NULL);
+   return(sCurrentKernel->fn);
+}
+
+
+/************************************************************************/
+/*>char *blGetGeomKernelName(void)
+   -------------------------------
+*//**
+
+   \return                      Name of the selected kernel
+
+-  18.10.26 Original
+*/
+char *blGetGeomKernelName(void)
+{
+   if(sCurrentKernel == NULL)
+      blSelectGeomKernel(NULL);
+   return(sCurrentKernel->name);
+}
+
+
+/************************************************************************/
+/*>GEOMKERNEL *blGetGeomKernels(int *nKernels)
+   -------------------------------------------
+*//**
+
+   \param[out]     *nKernels    Number of kernel variants
+   \return                      Table of kernel variants, flagged with
+                                whether this CPU supports them
+
+-  18.10.26 Original
+*/
+GEOMKERNEL *blGetGeomKernels(int *nKernels)
+{
+   CheckCPU();
+   *nKernels = NKERNELS;
+   return(sKernels);
+}
+
+
+/************************************************************************/
+/*>static void CheckCPU(void)
+   --------------------------
+*//**
+
+   Flags the kernel variants that this CPU can run
+
+-  18.10.26 Original
+*/
+static void CheckCPU(void)
+{
+   int i;
+
+   if(sCPUChecked)
+      return;
+
+   for(i=0; i<NKERNELS; i++)
+   {
+      if(!strcmp(sKernels[i].name, "avx512"))
+         sKernels[i].supported = CPU_SUPPORTS("avx512f") &&
+                                 CPU_SUPPORTS("avx512vl") &&
+                                 CPU_SUPPORTS("avx512dq");
+      else if(!strcmp(sKernels[i].name, "avx2"))
+         sKernels[i].supported = CPU_SUPPORTS("avx2");
+   }
+   sCPUChecked = TRUE;
+}
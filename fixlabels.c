@@ -3,8 +3,8 @@
 
    \file       pdbflip.c
    
-   \version    V2.0
-   \date       13.03.23
+   \version    V2.7
+   \date       18.10.26
    \brief      Standardise equivalent atom labelling
    
    \copyright  (c) UCL, Prof. Andrew C. R. Martin 1996-2023
@@ -55,11 +55,42 @@
 -  V1.5   12.03.15 Changed to allow multi-character chain names
 -  V2.0   13.03.23 Complete rewrite for new flipping code which is now
                    in BiopLib
+-  V2.1   18.10.26 Added -b batch mode to process many files in one run
+                   with read-ahead of the next input file and large
+                   stdio buffers
+                   By: agent
+-  V2.2   18.10.26 Added -m job mode with a checkpoint log so that
+                   manifest runs can be restarted and shared between
+                   processes
+                   By: agent
+-  V2.3   18.10.26 Added -a to aggregate torsion statistics over many
+                   files
+                   By: agent
+-  V2.4   18.10.26 Hydrogens are now swapped as well   By: agent
+-  V2.5   18.10.26 Added --kernel= to choose the geometry kernel and
+                   --selftest to check that all kernels agree
+                   By: agent
+-  V2.6   18.10.26 Batch, job and aggregate modes read and write files
+                   through an io_uring I/O engine (with a blocking
+                   fallback) which reads several files ahead and
+                   writes and syncs outputs behind. Batch mode never
+                   overwrites its inputs
+                   By: agent
+-  V2.7   18.10.26 Job mode fails manifest entries which would write the
+                   same output file as an earlier entry and locks
+                   shards in a single lock file
+                   By: agent
 
 *************************************************************************/
 /* Includes
 */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "bioplib/SysDefs.h"
 #include "bioplib/general.h"
@@ -67,16 +98,23 @@
 #include "bioplib/macros.h"
 #include "bioplib/angle.h"
 #include "FixAtomLabels.h"
+#include "JobControl.h"
+#include "GeomKernels.h"
+#include "AsyncIO.h"
 
 /************************************************************************/
 /* Defines and macros
 */
 #define MAXBUFF 160
 #define FAL_ERROR_VALUE 9999.0
+#define READAHEAD 8           /* Input files read ahead                 */
+#define WRITEBEHIND 16        /* Output files written behind            */
+#define DEFSHARDSIZE 100      /* Default manifest entries per job shard */
 
 /************************************************************************/
 /* Globals
 */
+static char **sSortFiles = NULL; /* Filenames for CompareNames()      */
 
 
 /************************************************************************/
@@ -84,7 +122,35 @@
 */
 int main(int argc, char **argv);
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                  int *verbosity, BOOL *reportOnly);
+                  int *verbosity, BOOL *reportOnly, char *batchDir,
+                  int *nBatchFiles, char ***batchFiles, char *manifest,
+                  char *ckptFile, int *shardSize, char *statsFile,
+                  char *kernelName, BOOL *selfTest);
+BOOL ProcessFile(FILE *in, FILE *out, int verbosity, BOOL reportOnly,
+                 int *nSwaps);
+BOOL ProcessBuffer(char *inData, size_t inSize, char **outData,
+                   size_t *outSize, int verbosity, BOOL reportOnly,
+                   int *nSwaps);
+int  QueueReads(AIOENGINE *aio, int *tickets, int nSubmitted, int upto,
+                MANIFESTENTRY *manifest, char **files, BOOL *skip);
+BOOL BuildOutputName(char *batchDir, char *infile, char *outfile,
+                     int outfileSize);
+char **ResolveOutputNames(int nFiles, MANIFESTENTRY *manifest,
+                          char **files, char *batchDir, int *nFailed);
+void FreeOutputNames(char **outfiles, int nFiles);
+char *FileBaseName(char *filename);
+char *CanonicalOutputName(char *outfile);
+BOOL IsSameFile(char *file1, char *file2);
+int  FlagDuplicateOutputs(int nFiles, MANIFESTENTRY *manifest,
+                          char **files, char **outfiles, BOOL *skip);
+static int CompareNames(const void *index1, const void *index2);
+int  RunBatch(char *batchDir, int nFiles, char **files, int verbosity,
+              BOOL reportOnly);
+int  RunJob(char *manifestFile, char *ckptFile, int shardSize,
+            char *batchDir, int verbosity, BOOL reportOnly);
+int  RunAggregate(char *statsFile, int nFiles, char **files,
+                  char *manifestFile, int verbosity);
+int  RunSelfTest(int nFiles, char **files, char *manifestFile);
 void Usage(void);
 
 /************************************************************************/
@@ -97,54 +163,1130 @@ void Usage(void);
 -  22.07.14 Renamed deprecated functions with bl prefix. By: CTP
 -  13.02.15 Added whole PDB support.  By: ACRM
 -  13.03.23 Complete rewrite to use new flip routines
+-  18.10.26 Moved processing into ProcessFile() and added batch mode
+            By: agent
+-  18.10.26 Added job mode   By: agent
+-  18.10.26 Added aggregate mode   By: agent
+-  18.10.26 Added kernel selection and self-test   By: agent
 */
 int main(int argc, char **argv)
 {
-   FILE     *in        = stdin,
-            *out       = stdout;
-   int      verbosity  = 0;
-   BOOL     reportOnly = FALSE;
+   FILE     *in          = stdin,
+            *out         = stdout;
+   int      verbosity    = 0,
+            nBatchFiles  = 0,
+            shardSize    = DEFSHARDSIZE;
+   BOOL     reportOnly   = FALSE,
+            selfTest     = FALSE;
    char     infile[MAXBUFF],
-            outfile[MAXBUFF];
+            outfile[MAXBUFF],
+            batchDir[MAXBUFF],
+            manifest[MAXBUFF],
+            ckptFile[MAXBUFF],
+            statsFile[MAXBUFF],
+            kernelName[MAXBUFF],
+            **batchFiles = NULL;
+   
+   if(ParseCmdLine(argc, argv, infile, outfile, &verbosity, &reportOnly,
+                   batchDir, &nBatchFiles, &batchFiles, manifest,
+                   ckptFile, &shardSize, statsFile, kernelName,
+                   &selfTest))
+   {
+      if(kernelName[0] && !blSelectGeomKernel(kernelName))
+      {
+         fprintf(stderr,"Kernel '%s' is unknown or not supported by \
+this CPU\n", kernelName);
+         return(1);
+      }
+      if(verbosity >= 1)
+      {
+         fprintf(stderr,"Using %s geometry kernel\n",
+                 blGetGeomKernelName());
+      }
+
+      if(selfTest)
+      {
+         if(RunSelfTest(nBatchFiles, batchFiles, manifest))
+            return(1);
+      }
+      else if(statsFile[0])
+      {
+         if(RunAggregate(statsFile, nBatchFiles, batchFiles, manifest,
+                         verbosity))
+            return(1);
+      }
+      else if(manifest[0])
+      {
+         if(RunJob(manifest, ckptFile, shardSize, batchDir, verbosity,
+                   reportOnly))
+            return(1);
+      }
+      else if(batchDir[0])
+      {
+         if(RunBatch(batchDir, nBatchFiles, batchFiles, verbosity,
+                     reportOnly))
+            return(1);
+      }
+      else if(blOpenStdFiles(infile, outfile, &in, &out))
+      {
+         ProcessFile(in, out, verbosity, reportOnly, NULL);
+      }
+   }
+   else
+   {
+      Usage();
+   }
+
+   return(0);
+}
+
+
+/************************************************************************/
+/*>BOOL ProcessFile(FILE *in, FILE *out, int verbosity, BOOL reportOnly,
+                    int *nSwaps)
+   ---------------------------------------------------------------------
+*//**
+
+   \param[in]      *in          Input PDB file pointer
+   \param[in]      *out         Output file pointer
+   \param[in]      verbosity    Information level
+   \param[in]      reportOnly   Report wrong residues rather than fixing
+   \param[out]     *nSwaps      Number of residues swapped (may be NULL)
+   \return                      Success?
+
+   Reads a PDB file and either fixes and writes it or reports on the
+   atom labels
+
+-  18.10.26 Original - split out of main()   By: agent
+-  18.10.26 Added nSwaps   By: agent
+-  18.10.26 Fails if blFixAtomLabels() runs out of memory   By: agent
+*/
+BOOL ProcessFile(FILE *in, FILE *out, int verbosity, BOOL reportOnly,
+                 int *nSwaps)
+{
    WHOLEPDB *wpdb;
+   int      swapCount = 0;
+
+   if((wpdb = blReadWholePDB(in)) == NULL)
+   {
+      fprintf(stderr,"No atoms read from PDB file\n");
+      return(FALSE);
+   }
+
+   if(reportOnly)
+   {
+      blPrintTorsionAtomLabels(out, wpdb->pdb);
+   }
+   else
+   {
+      if((swapCount = blFixAtomLabels(wpdb->pdb, verbosity)) < 0)
+      {
+         fprintf(stderr,"No memory to fix atom labels\n");
+         blFreeWholePDB(wpdb);
+         return(FALSE);
+      }
+      blWriteWholePDB(out, wpdb);
+   }
+   blFreeWholePDB(wpdb);
+
+   if(nSwaps != NULL)
+      *nSwaps = swapCount;
+
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>BOOL ProcessBuffer(char *inData, size_t inSize, char **outData,
+                      size_t *outSize, int verbosity, BOOL reportOnly,
+                      int *nSwaps)
+   ---------------------------------------------------------------------
+*//**
+
+   \param[in]      *inData      Contents of the input PDB file
+   \param[in]      inSize       Size of the input
+   \param[out]     **outData    Output (malloc()'d - the caller must free
+                                this)
+   \param[out]     *outSize     Size of the output
+   \param[in]      verbosity    Information level
+   \param[in]      reportOnly   Report wrong residues rather than fixing
+   \param[out]     *nSwaps      Number of residues swapped (may be NULL)
+   \return                      Success?
+
+   Processes a PDB file which has been read into memory, writing the
+   result to memory so that the I/O engine can read and write whole
+   files
+
+-  18.10.26 Original - replaces ProcessNamedFile()   By: agent
+*/
+BOOL ProcessBuffer(char *inData, size_t inSize, char **outData,
+                   size_t *outSize, int verbosity, BOOL reportOnly,
+                   int *nSwaps)
+{
+   FILE *in, *out;
+   BOOL ok;
+
+   *outData = NULL;
+   *outSize = 0;
+
+   if(inSize == 0)
+   {
+      fprintf(stderr,"No atoms read from PDB file\n");
+      return(FALSE);
+   }
+   if((in = fmemopen(inData, inSize, "r")) == NULL)
+   {
+      fprintf(stderr,"No memory to read PDB file\n");
+      return(FALSE);
+   }
+   if((out = open_memstream(outData, outSize)) == NULL)
+   {
+      fprintf(stderr,"No memory to write PDB file\n");
+      fclose(in);
+      return(FALSE);
+   }
+
+   ok = ProcessFile(in, out, verbosity, reportOnly, nSwaps);
+   fclose(in);
+   if(fclose(out))
+      ok = FALSE;
+
+   if(!ok)
+   {
+      FREE(*outData);
+      *outSize = 0;
+   }
+   return(ok);
+}
+
+
+/************************************************************************/
+/*>int QueueReads(AIOENGINE *aio, int *tickets, int nSubmitted,
+                  int upto, MANIFESTENTRY *manifest, char **files,
+                  BOOL *skip)
+   ---------------------------------------------------------------------
+*//**
+
+   \param[in]      *aio         I/O engine
+   \param[in,out]  *tickets     READAHEAD read tickets. The ticket for
+                                file i is in tickets[i % READAHEAD]
+   \param[in]      nSubmitted   Index of the next file to be read
+   \param[in]      upto         Read files up to (but not including)
+                                this index
+   \param[in]      *manifest    Manifest listing input files (or NULL
+                                to use files)
+   \param[in]      **files      Input filenames
+   \param[in]      *skip        Files not to be read (or NULL to read
+                                them all). Their tickets are set to -1
+   \return                      Index of the next file to be read
+
+   Starts reading the input files ahead of the one being processed.
+   upto must be no more than READAHEAD beyond the file being processed.
+
+-  18.10.26 Original   By: agent
+-  18.10.26 Added skip   By: agent
+*/
+int QueueReads(AIOENGINE *aio, int *tickets, int nSubmitted, int upto,
+               MANIFESTENTRY *manifest, char **files, BOOL *skip)
+{
+   for(; nSubmitted<upto; nSubmitted++)
+   {
+      if((skip != NULL) && skip[nSubmitted])
+      {
+         tickets[nSubmitted % READAHEAD] = -1;
+         continue;
+      }
+      tickets[nSubmitted % READAHEAD] =
+         AIOSubmitRead(aio, (manifest ? manifest[nSubmitted].infile :
+                                        files[nSubmitted]));
+   }
+   return(nSubmitted);
+}
+
+
+/************************************************************************/
+/*>BOOL BuildOutputName(char *batchDir, char *infile, char *outfile,
+                        int outfileSize)
+   ---------------------------------------------------------------------
+*//**
+
+   \param[in]      *batchDir    Output directory
+   \param[in]      *infile      Input filename
+   \param[out]     *outfile     Output filename
+   \param[in]      outfileSize  Size of the outfile buffer
+   \return                      Success?
+
+   Builds the name of a file in batchDir with the same name as infile
+
+-  18.10.26 Original - split out of RunBatch()   By: agent
+*/
+BOOL BuildOutputName(char *batchDir, char *infile, char *outfile,
+                     int outfileSize)
+{
+   if(snprintf(outfile, outfileSize, "%s/%s", batchDir, 
+               FileBaseName(infile)) >= outfileSize)
+   {
+      fprintf(stderr,"Output filename too long for %s\n", infile);
+      return(FALSE);
+   }
+   return(TRUE);
+}
+
+
+/************************************************************************/
+/*>char **ResolveOutputNames(int nFiles, MANIFESTENTRY *manifest,
+                             char **files, char *batchDir, int *nFailed)
+   ---------------------------------------------------------------------
+*//**
+
+   \param[in]      nFiles       Number of input files
+   \param[in]      *manifest    Manifest listing input and output files
+                                (or NULL to use files)
+   \param[in]      **files      Input filenames
+   \param[in]      *batchDir    Output directory for inputs without an
+                                output file (or blank string)
+   \param[out]     *nFailed     Number of inputs without an output file
+   \return                      Array of output filenames (NULL if no
+                                memory). Free with FreeOutputNames()
+
+   Works out the output file for every input before any are processed
+   so that inputs which would write the same output can be found. The
+   output is the one given in the manifest or, failing that, a file of
+   the same name in batchDir. Entries are NULL for inputs without an
+   output file, which are reported and counted in nFailed.
+
+-  18.10.26 Original   By: agent
+*/
+char **ResolveOutputNames(int nFiles, MANIFESTENTRY *manifest,
+                          char **files, char *batchDir, int *nFailed)
+{
+   char **outfiles,
+        outfile[2*MAXBUFF];
+   int  i;
+
+   *nFailed = 0;
+   if((outfiles = (char **)malloc((nFiles+1) * sizeof(char *))) == NULL)
+      return(NULL);
+
+   for(i=0; i<nFiles; i++)
+   {
+      char *infile = (manifest ? manifest[i].infile : files[i]);
+
+      outfiles[i] = NULL;
+      if((manifest != NULL) && (manifest[i].outfile != NULL))
+      {
+         outfiles[i] = strdup(manifest[i].outfile);
+      }
+      else if(!batchDir[0])
+      {
+         fprintf(stderr,"No output file given for %s\n", infile);
+         (*nFailed)++;
+         continue;
+      }
+      else if(BuildOutputName(batchDir, infile, outfile, 
+                              sizeof(outfile)))
+      {
+         outfiles[i] = strdup(outfile);
+      }
+      else
+      {
+         (*nFailed)++;
+         continue;
+      }
+
+      if(outfiles[i] == NULL)
+      {
+         fprintf(stderr,"No memory for output filename of %s\n", infile);
+         (*nFailed)++;
+      }
+   }
+   return(outfiles);
+}
+
+
+/************************************************************************/
+/*>void FreeOutputNames(char **outfiles, int nFiles)
+   -------------------------------------------------
+*//**
+
+   \param[in]      **outfiles   Output filenames from
+                                ResolveOutputNames()
+   \param[in]      nFiles       Number of input files
+
+-  18.10.26 Original   By: agent
+*/
+void FreeOutputNames(char **outfiles, int nFiles)
+{
+   int i;
+
+   if(outfiles != NULL)
+   {
+      for(i=0; i<nFiles; i++)
+         FREE(outfiles[i]);
+      free(outfiles);
+   }
+}
+
+
+/************************************************************************/
+/*>char *FileBaseName(char *filename)
+   ----------------------------------
+*//**
+
+   \param[in]      *filename    Filename with optional path
+   \return                      Pointer to the filename without the path
+
+-  18.10.26 Original - split out of BuildOutputName()   By: agent
+*/
+char *FileBaseName(char *filename)
+{
+   char *basename;
+
+   if((basename = strrchr(filename, '/')) != NULL)
+      return(basename+1);
+   return(filename);
+}
+
+
+/************************************************************************/
+/*>char *CanonicalOutputName(char *outfile)
+   ----------------------------------------
+*//**
+
+   \param[in]      *outfile     Output filename
+   \return                      Output filename with the directory made
+                                absolute (NULL if no memory)
+
+   Resolves the directory part of an output filename so that different
+   spellings of the same output file (out/x.pdb, ./out/x.pdb,
+   out//x.pdb) compare equal. If the directory cannot be resolved (for
+   example because it does not exist yet) a copy of the name is
+   returned unchanged.
+
+-  18.10.26 Original   By: agent
+*/
+char *CanonicalOutputName(char *outfile)
+{
+   char *basename = FileBaseName(outfile),
+        *dirname,
+        *realDir,
+        *canonical;
+
+   if(basename == outfile)
+   {
+      dirname = strdup(".");
+   }
+   else if((dirname = strdup(outfile)) != NULL)
+   {
+      dirname[basename - outfile] = '\0';
+   }
+   if(dirname == NULL)
+      return(NULL);
+
+   realDir = realpath(dirname, NULL);
+   free(dirname);
+   if(realDir == NULL)
+      return(strdup(outfile));
+
+   if((canonical = (char *)malloc(strlen(realDir) + strlen(basename) + 2))
+      != NULL)
+   {
+      sprintf(canonical, "%s/%s", realDir, basename);
+   }
+   free(realDir);
+   return(canonical);
+}
+
+
+/************************************************************************/
+/*>BOOL IsSameFile(char *file1, char *file2)
+   -----------------------------------------
+*//**
+
+   \param[in]      *file1       First filename
+   \param[in]      *file2       Second filename
+   \return                      Do both names refer to the same existing
+                                file?
+
+-  18.10.26 Original   By: agent
+*/
+BOOL IsSameFile(char *file1, char *file2)
+{
+   struct stat stat1, stat2;
+
+   if(stat(file1, &stat1) || stat(file2, &stat2))
+      return(FALSE);
+   return((stat1.st_dev == stat2.st_dev) &&
+          (stat1.st_ino == stat2.st_ino));
+}
+
+
+/************************************************************************/
+/*>int FlagDuplicateOutputs(int nFiles, MANIFESTENTRY *manifest,
+                             char **files, char **outfiles, BOOL *skip)
+   ---------------------------------------------------------------------
+*//**
+
+   \param[in]      nFiles       Number of input files
+   \param[in]      *manifest    Manifest listing input files (or NULL
+                                to use files)
+   \param[in]      **files      Input filenames
+   \param[in]      **outfiles   Output filenames. NULL entries are
+                                flagged but not counted
+   \param[out]     *skip        Set for inputs which must be skipped
+   \return                      Number of inputs flagged as duplicates
+
+   Inputs which would write the same output file would overwrite each
+   other. In batch mode this happens for inputs with the same name in
+   different directories; in job mode the manifest may also name the
+   same output twice. The first input for each output is kept and the
+   others are flagged to be skipped.
+
+-  18.10.26 Original   By: agent
+-  18.10.26 Compares the output filenames so it can be used in job
+            mode   By: agent
+*/
+int FlagDuplicateOutputs(int nFiles, MANIFESTENTRY *manifest,
+                         char **files, char **outfiles, BOOL *skip)
+{
+   char **keys;
+   int  *order,
+        i,
+        nOutputs    = 0,
+        nDuplicates = 0;
+
+   keys  = (char **)malloc((nFiles+1) * sizeof(char *));
+   order = (int *)malloc((nFiles+1) * sizeof(int));
+   if((keys == NULL) || (order == NULL))
+   {
+      /* Fail everything rather than risk outputs overwriting others   */
+      fprintf(stderr,"No memory to check for duplicate outputs\n");
+      for(i=0; i<nFiles; i++)
+         skip[i] = TRUE;
+      FREE(keys);
+      FREE(order);
+      return(nFiles);
+   }
+
+   for(i=0; i<nFiles; i++)
+   {
+      keys[i] = NULL;
+      skip[i] = TRUE;
+      if(outfiles[i] == NULL)
+         continue;
+      if((keys[i] = CanonicalOutputName(outfiles[i])) == NULL)
+      {
+         fprintf(stderr,"No memory to check output %s. Skipped\n",
+                 outfiles[i]);
+         nDuplicates++;
+         continue;
+      }
+      skip[i]           = FALSE;
+      order[nOutputs++] = i;
+   }
+
+   sSortFiles = keys;
+   qsort(order, nOutputs, sizeof(int), CompareNames);
+   sSortFiles = NULL;
+
+   for(i=1; i<nOutputs; i++)
+   {
+      if(!strcmp(keys[order[i]], keys[order[i-1]]))
+      {
+         int this = order[i],
+             prev = order[i-1];
+         
+         fprintf(stderr,"%s would write the same output file, %s, as \
+%s. Skipped\n",
+                 (manifest ? manifest[this].infile : files[this]),
+                 outfiles[this],
+                 (manifest ? manifest[prev].infile : files[prev]));
+         skip[order[i]] = TRUE;
+         nDuplicates++;
+      }
+   }
+
+   for(i=0; i<nFiles; i++)
+      FREE(keys[i]);
+   free(keys);
+   free(order);
+   return(nDuplicates);
+}
+
+
+/************************************************************************/
+/*>static int CompareNames(const void *index1, const void *index2)
+   ---------------------------------------------------------------
+*//**
+
+   \param[in]      *index1      Pointer to first index into sSortFiles
+   \param[in]      *index2      Pointer to second index into sSortFiles
+   \return                      qsort() comparison
+
+   Sorts by name and then by position on the command line or in the
+   manifest
+
+-  18.10.26 Original   By: agent
+-  18.10.26 Renamed from CompareBaseNames() and compares the whole
+            name   By: agent
+*/
+static int CompareNames(const void *index1, const void *index2)
+{
+   int i1 = *(const int *)index1,
+       i2 = *(const int *)index2,
+       cmp;
+
+   if((cmp = strcmp(sSortFiles[i1], sSortFiles[i2])) != 0)
+      return(cmp);
+   return(i1 - i2);
+}
+
+
+/************************************************************************/
+/*>int RunBatch(char *batchDir, int nFiles, char **files, int verbosity,
+                BOOL reportOnly)
+   ---------------------------------------------------------------------
+*//**
+
+   \param[in]      *batchDir    Output directory
+   \param[in]      nFiles       Number of input files
+   \param[in]      **files      Input filenames
+   \param[in]      verbosity    Information level
+   \param[in]      reportOnly   Report wrong residues rather than fixing
+   \return                      Number of files that failed
+
+   Processes a list of files in a single run, writing each to a file of
+   the same name in batchDir. The I/O engine reads up to READAHEAD
+   files ahead of the one being processed and writes up to WRITEBEHIND
+   outputs behind it. Each output is written to a temporary file which
+   is synced and renamed; the directory is synced once at the end.
+   Inputs which would give the same output file as an earlier one, or
+   whose output would be the input itself, are skipped.
+
+-  18.10.26 Original   By: agent
+-  18.10.26 Skips inputs with duplicate names   By: agent
+-  18.10.26 Uses the I/O engine for read-ahead and write-behind
+            By: agent
+-  18.10.26 Output names are worked out before processing
+            By: agent
+-  18.10.26 Names the I/O engine with AIOEngineName()   By: agent
+*/
+int RunBatch(char *batchDir, int nFiles, char **files, int verbosity,
+             BOOL reportOnly)
+{
+   AIOENGINE *aio = NULL;
+   int       i,
+             nTodo      = 0,
+             nSubmitted = 0,
+             nFailed    = 0,
+             tickets[READAHEAD];
+   char      **outfiles,
+             **todo,
+             **todoOut;
+   BOOL      *skip;
+
+   outfiles = ResolveOutputNames(nFiles, NULL, files, batchDir, &nFailed);
+   skip     = (BOOL *)malloc((nFiles+1) * sizeof(BOOL));
+   todo     = (char **)malloc((nFiles+1) * sizeof(char *));
+   todoOut  = (char **)malloc((nFiles+1) * sizeof(char *));
+   if((outfiles == NULL) || (skip == NULL) || (todo == NULL) ||
+      (todoOut == NULL) ||
+      ((aio = CreateAIOEngine(READAHEAD, WRITEBEHIND)) == NULL))
+   {
+      fprintf(stderr,"No memory for batch\n");
+      FreeOutputNames(outfiles, nFiles);
+      FREE(skip);
+      FREE(todo);
+      FREE(todoOut);
+      return(1);
+   }
+   if(verbosity >= 2)
+   {
+      fprintf(stderr,"Using %s I/O\n", AIOEngineName(aio));
+   }
+
+   nFailed += FlagDuplicateOutputs(nFiles, NULL, files, outfiles, skip);
+   for(i=0; i<nFiles; i++)
+   {
+      if(!skip[i])
+      {
+         todo[nTodo]      = files[i];
+         todoOut[nTodo++] = outfiles[i];
+      }
+   }
    
-   if(ParseCmdLine(argc, argv, infile, outfile, &verbosity, &reportOnly))
+   for(i=0; i<nTodo; i++)
    {
-      if(blOpenStdFiles(infile, outfile, &in, &out))
+      char   *inData, *outData;
+      size_t inSize, outSize;
+      BOOL   ok;
+
+      nSubmitted = QueueReads(aio, tickets, nSubmitted,
+                              MIN(i+READAHEAD, nTodo), NULL, todo, NULL);
+      if(!AIOWaitRead(aio, tickets[i % READAHEAD], &inData, &inSize))
+      {
+         fprintf(stderr,"Unable to read %s\n", todo[i]);
+         nFailed++;
+         continue;
+      }
+      
+      if(IsSameFile(todo[i], todoOut[i]))
+      {
+         fprintf(stderr,"Output file %s is the input file. Skipped\n",
+                 todoOut[i]);
+         free(inData);
+         nFailed++;
+         continue;
+      }
+
+      if(verbosity >= 1)
+         fprintf(stderr,"Processing %s\n", todo[i]);
+
+      ok = ProcessBuffer(inData, inSize, &outData, &outSize, verbosity,
+                         reportOnly, NULL);
+      free(inData);
+      if(!ok)
       {
-         if((wpdb = blReadWholePDB(in)) != NULL)
+         nFailed++;
+         continue;
+      }
+
+      /* Failures are counted by AIOFlushWrites()                      */
+      AIOSubmitWrite(aio, todoOut[i], outData, outSize);
+   }
+
+   nFailed += AIOFlushWrites(aio);
+   FreeAIOEngine(aio);
+
+   if(nTodo && !SyncDirectory(batchDir))
+   {
+      fprintf(stderr,"Unable to sync directory %s\n", batchDir);
+      nFailed++;
+   }
+
+   FreeOutputNames(outfiles, nFiles);
+   free(todoOut);
+   free(todo);
+   free(skip);
+   return(nFailed);
+}
+
+
+/************************************************************************/
+/*>int RunJob(char *manifestFile, char *ckptFile, int shardSize,
+              char *batchDir, int verbosity, BOOL reportOnly)
+   ---------------------------------------------------------------------
+*//**
+
+   \param[in]      *manifestFile Manifest filename
+   \param[in]      *ckptFile    Checkpoint log filename
+   \param[in]      shardSize    Number of manifest entries per shard
+   \param[in]      *batchDir    Output directory for manifest entries
+                                without an output file (or blank string)
+   \param[in]      verbosity    Information level
+   \param[in]      reportOnly   Report wrong residues rather than fixing
+   \return                      Number of files that failed
+
+   Processes the files listed in a manifest, skipping any already
+   recorded as complete in the checkpoint log. Each shard of the
+   manifest is only processed if we can claim it, so several processes
+   may be run on the same manifest and checkpoint log. The I/O engine
+   reads up to READAHEAD files ahead within the shard. Outputs are
+   written atomically, and the directory holding them synced, before
+   being recorded in the log, so a job killed at any point (even by a
+   power failure) may simply be restarted. The outputs of all entries
+   are worked out first and any entry which would write the same
+   output as an earlier one fails, whichever shard it is in.
+
+-  18.10.26 Original   By: agent
+-  18.10.26 Uses the I/O engine to read ahead   By: agent
+-  18.10.26 Completion is keyed on the output file and mode as well
+            By: agent
+-  18.10.26 Syncs the output directory before writing the checkpoint
+            By: agent
+-  18.10.26 Fails entries which would write the same output as an
+            earlier one   By: agent
+-  18.10.26 Shards are claimed through the checkpoint   By: agent
+*/
+int RunJob(char *manifestFile, char *ckptFile, int shardSize,
+           char *batchDir, int verbosity, BOOL reportOnly)
+{
+   MANIFESTENTRY *manifest;
+   CHECKPOINT    *ckpt;
+   AIOENGINE     *aio;
+   int           nEntries,
+                 nShards,
+                 shard,
+                 nFailed  = 0,
+                 nSkipped = 0,
+                 nDone    = 0,
+                 nBusy    = 0,
+                 nNoOutput,
+                 tickets[READAHEAD];
+   char          **outfiles;
+   BOOL          *skip;
+
+   if((manifest = ReadManifest(manifestFile, &nEntries)) == NULL)
+   {
+      fprintf(stderr,"Unable to read manifest %s\n", manifestFile);
+      return(1);
+   }
+   if((ckpt = OpenCheckpoint(ckptFile)) == NULL)
+   {
+      fprintf(stderr,"Unable to open checkpoint log %s\n", ckptFile);
+      FreeManifest(manifest, nEntries);
+      return(1);
+   }
+   /* Entries without an output are failed in the loop below, so they
+      are only counted by the process which holds their shard
+   */
+   outfiles = ResolveOutputNames(nEntries, manifest, NULL, batchDir,
+                                 &nNoOutput);
+   skip     = (BOOL *)malloc((nEntries+1) * sizeof(BOOL));
+   if((outfiles == NULL) || (skip == NULL) ||
+      ((aio = CreateAIOEngine(READAHEAD, 0)) == NULL))
+   {
+      fprintf(stderr,"No memory for job\n");
+      FreeOutputNames(outfiles, nEntries);
+      FREE(skip);
+      CloseCheckpoint(ckpt);
+      FreeManifest(manifest, nEntries);
+      return(1);
+   }
+
+   /* Every process sees the same manifest, so all agree which entries
+      are duplicates
+   */
+   FlagDuplicateOutputs(nEntries, manifest, NULL, outfiles, skip);
+
+   nShards = (nEntries + shardSize - 1) / shardSize;
+   for(shard=0; shard<nShards; shard++)
+   {
+      int i, last, nSubmitted;
+
+      if(!ClaimShard(ckpt, shard))
+      {
+         nBusy++;
+         continue;
+      }
+
+      /* Pick up anything completed since we last looked               */
+      if(!ReadCheckpoint(ckpt))
+      {
+         fprintf(stderr,"Unable to read checkpoint log %s\n", ckptFile);
+         ReleaseShard(ckpt, shard);
+         nFailed++;
+         break;
+      }
+
+      last       = MIN((shard+1) * shardSize, nEntries);
+      nSubmitted = shard * shardSize;
+      for(i=shard*shardSize; i<last; i++)
+      {
+         char     *infile      = manifest[i].infile,
+                  *thisOutfile = outfiles[i],
+                  *inData,
+                  *outData;
+         size_t   inSize,
+                  outSize;
+         uint64_t hash;
+         int      nSwaps;
+         BOOL     ok;
+
+         nSubmitted = QueueReads(aio, tickets, nSubmitted,
+                                 MIN(i+READAHEAD, last), manifest, NULL,
+                                 skip);
+
+         /* No output file, or a duplicate; already reported           */
+         if(skip[i])
          {
-            PDB *pdb;
-            pdb = wpdb->pdb;
-            if(reportOnly)
-            {
-               blPrintTorsionAtomLabels(out, pdb);
-            }
-            else
-            {
-               blFixAtomLabels(pdb, verbosity);
-               blWriteWholePDB(out, wpdb);
-            }
-            FREELIST(pdb, PDB);
+            nFailed++;
+            continue;
          }
-         else
+
+         if(!AIOWaitRead(aio, tickets[i % READAHEAD], &inData, &inSize))
          {
-            fprintf(stderr,"No atoms read from PDB file\n");
+            fprintf(stderr,"Unable to read %s\n", infile);
+            nFailed++;
+            continue;
          }
+
+         /* The output file and mode are part of the key so that a run
+            with -r, or to another directory, is not skipped
+         */
+         hash = HashBuffer(inData, inSize);
+         if(IsCompleted(ckpt, infile, thisOutfile, reportOnly, hash))
+         {
+            free(inData);
+            nSkipped++;
+            continue;
+         }
+         if(IsSameFile(infile, thisOutfile))
+         {
+            fprintf(stderr,"Output file %s is the input file. Skipped\n",
+                    thisOutfile);
+            free(inData);
+            nFailed++;
+            continue;
+         }
+
+         if(verbosity >= 1)
+            fprintf(stderr,"Processing %s\n", infile);
+
+         ok = ProcessBuffer(inData, inSize, &outData, &outSize, verbosity,
+                            reportOnly, &nSwaps);
+         free(inData);
+         if(ok)
+         {
+            ok = WriteFileAtomic(thisOutfile, outData, outSize);
+            free(outData);
+         }
+         if(!ok)
+         {
+            nFailed++;
+            continue;
+         }
+
+         /* The rename must be on disk before the log says we are done  */
+         if(!SyncFileDirectory(thisOutfile))
+         {
+            fprintf(stderr,"Unable to sync directory of %s\n",
+                    thisOutfile);
+            nFailed++;
+            continue;
+         }
+         
+         if(!AppendCheckpoint(ckpt, infile, thisOutfile, reportOnly, hash,
+                              nSwaps))
+         {
+            fprintf(stderr,"Unable to write checkpoint log %s\n",
+                    ckptFile);
+            nFailed++;
+            continue;
+         }
+         nDone++;
+      }
+      
+      ReleaseShard(ckpt, shard);
+   }
+
+   if(verbosity >= 1)
+   {
+      fprintf(stderr,"Job %s: %d processed, %d already complete, %d \
+failed, %d shards held by other processes\n",
+              manifestFile, nDone, nSkipped, nFailed, nBusy);
+   }
+
+   FreeAIOEngine(aio);
+   FreeOutputNames(outfiles, nEntries);
+   free(skip);
+   CloseCheckpoint(ckpt);
+   FreeManifest(manifest, nEntries);
+   
+   return(nFailed);
+}
+
+
+/************************************************************************/
+/*>int RunAggregate(char *statsFile, int nFiles, char **files,
+                    char *manifestFile, int verbosity)
+   ---------------------------------------------------------------------
+*//**
+
+   \param[in]      *statsFile   Output statistics file
+   \param[in]      nFiles       Number of input files
+   \param[in]      **files      Input filenames
+   \param[in]      *manifestFile Manifest listing input files (or blank
+                                string to use files)
+   \param[in]      verbosity    Information level
+   \return                      Number of files that failed
+
+   Reads each of the input files and accumulates statistics on the
+   torsions used to decide whether to swap atom labels, writing a
+   single JSON summary at the end rather than a report per residue.
+   The I/O engine reads up to READAHEAD files ahead.
+
+-  18.10.26 Original   By: agent
+-  18.10.26 Uses the I/O engine to read ahead   By: agent
+*/
+int RunAggregate(char *statsFile, int nFiles, char **files,
+                 char *manifestFile, int verbosity)
+{
+   MANIFESTENTRY   *manifest = NULL;
+   FALTORSIONSTATS *stats;
+   AIOENGINE       *aio;
+   FILE            *fp;
+   int             i,
+                   nEntries   = 0,
+                   nFailed    = 0,
+                   nSubmitted = 0,
+                   tickets[READAHEAD];
+
+   if(manifestFile[0])
+   {
+      if((manifest = ReadManifest(manifestFile, &nEntries)) == NULL)
+      {
+         fprintf(stderr,"Unable to read manifest %s\n", manifestFile);
+         return(1);
       }
+      nFiles = nEntries;
+   }
+
+   stats = (FALTORSIONSTATS *)malloc(sizeof(FALTORSIONSTATS));
+   if((stats == NULL) ||
+      ((aio = CreateAIOEngine(READAHEAD, 0)) == NULL))
+   {
+      fprintf(stderr,"No memory for torsion statistics\n");
+      FREE(stats);
+      FreeManifest(manifest, nEntries);
+      return(1);
+   }
+   blInitTorsionStats(stats);
+   
+   for(i=0; i<nFiles; i++)
+   {
+      char     *infile,
+               *inData;
+      size_t   inSize;
+      WHOLEPDB *wpdb = NULL;
+
+      infile     = (manifest ? manifest[i].infile : files[i]);
+      nSubmitted = QueueReads(aio, tickets, nSubmitted,
+                              MIN(i+READAHEAD, nFiles), manifest, files,
+                              NULL);
+      if(!AIOWaitRead(aio, tickets[i % READAHEAD], &inData, &inSize))
+      {
+         fprintf(stderr,"Unable to read %s\n", infile);
+         nFailed++;
+         continue;
+      }
+
+      if(verbosity >= 1)
+         fprintf(stderr,"Processing %s\n", infile);
+      
+      if(inSize && ((fp = fmemopen(inData, inSize, "r")) != NULL))
+      {
+         wpdb = blReadWholePDB(fp);
+         fclose(fp);
+      }
+      
+      if(wpdb == NULL)
+      {
+         fprintf(stderr,"No atoms read from PDB file %s\n", infile);
+         nFailed++;
+      }
+      else
+      {
+         if(!blAccumulateTorsionStats(stats, wpdb->pdb))
+         {
+            fprintf(stderr,"No memory to accumulate torsions for %s\n",
+                    infile);
+            nFailed++;
+         }
+         blFreeWholePDB(wpdb);
+      }
+      free(inData);
+   }
+   FreeAIOEngine(aio);
+
+   if((fp = fopen(statsFile, "w")) == NULL)
+   {
+      fprintf(stderr,"Unable to write %s\n", statsFile);
+      nFailed++;
    }
    else
    {
-      Usage();
+      blWriteTorsionStats(fp, stats);
+      if(fclose(fp))
+      {
+         fprintf(stderr,"Error writing %s\n", statsFile);
+         nFailed++;
+      }
    }
 
-   return(0);
+   free(stats);
+   FreeManifest(manifest, nEntries);
+   
+   return(nFailed);
+}
+
+
+/************************************************************************/
+/*>int RunSelfTest(int nFiles, char **files, char *manifestFile)
+   -------------------------------------------------------------
+*//**
+
+   \param[in]      nFiles       Number of input files
+   \param[in]      **files      Input filenames
+   \param[in]      *manifestFile Manifest listing input files (or blank
+                                string to use files)
+   \return                      Number of files that failed or where
+                                the kernels disagreed
+
+   Runs all the geometry kernels supported by this CPU over each input
+   file and checks that they make the same swap decisions
+
+-  18.10.26 Original   By: agent
+*/
+int RunSelfTest(int nFiles, char **files, char *manifestFile)
+{
+   MANIFESTENTRY *manifest = NULL;
+   FILE          *fp;
+   int           i,
+                 nEntries  = 0,
+                 nFailed   = 0;
+
+   if(manifestFile[0])
+   {
+      if((manifest = ReadManifest(manifestFile, &nEntries)) == NULL)
+      {
+         fprintf(stderr,"Unable to read manifest %s\n", manifestFile);
+         return(1);
+      }
+      nFiles = nEntries;
+   }
+
+   for(i=0; i<nFiles; i++)
+   {
+      char     *infile;
+      WHOLEPDB *wpdb;
+
+      infile = (manifest ? manifest[i].infile : files[i]);
+      if((fp = fopen(infile, "r")) == NULL)
+      {
+         fprintf(stderr,"Unable to read %s\n", infile);
+         nFailed++;
+         continue;
+      }
+
+      if((wpdb = blReadWholePDB(fp)) == NULL)
+      {
+         fprintf(stderr,"No atoms read from PDB file %s\n", infile);
+         nFailed++;
+      }
+      else
+      {
+         fprintf(stdout, "%s:\n", infile);
+         if(blTestGeomKernels(stdout, wpdb->pdb))
+            nFailed++;
+         blFreeWholePDB(wpdb);
+      }
+      fclose(fp);
+   }
+
+   fprintf(stdout, "Self-test %s\n", nFailed ? "FAILED" : "passed");
+   FreeManifest(manifest, nEntries);
+   
+   return(nFailed);
 }
 
 
 /************************************************************************/
 /*>BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                     int *verbosity, BOOL *reportOnly)
+                     int *verbosity, BOOL *reportOnly, char *batchDir,
+                     int *nBatchFiles, char ***batchFiles, char *manifest,
+                     char *ckptFile, int *shardSize, char *statsFile,
+                     char *kernelName, BOOL *selfTest)
    ---------------------------------------------------------------------
 *//**
 
@@ -154,22 +1296,46 @@ int main(int argc, char **argv)
    \param[out]     *outfile     Output file (or blank string)
    \param[out]     *verbosity   Information level
    \param[out]     *reportOnly  Report wrong residues rather than fixing
+   \param[out]     *batchDir    Batch mode output directory (or blank
+                                string)
+   \param[out]     *nBatchFiles Number of batch mode input files
+   \param[out]     ***batchFiles Batch mode input files (points into
+                                argv)
+   \param[out]     *manifest    Job mode manifest file (or blank string)
+   \param[out]     *ckptFile    Job mode checkpoint log
+   \param[out]     *shardSize   Job mode manifest entries per shard
+   \param[out]     *statsFile   Aggregate mode output file (or blank
+                                string)
+   \param[out]     *kernelName  Geometry kernel to use (or blank string)
+   \param[out]     *selfTest    Test the geometry kernels
    \return                      Success?
 
    Parse the command line
    
 -  08.11.96 Original    By: ACRM
 -  13.02.23 Updated for V2.0
+-  18.10.26 Added -b   By: agent
+-  18.10.26 Added -m, -c and -s   By: agent
+-  18.10.26 Added -a   By: agent
+-  18.10.26 Added --kernel= and --selftest   By: agent
 */
 BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
-                  int *verbosity, BOOL *reportOnly)
+                  int *verbosity, BOOL *reportOnly, char *batchDir,
+                  int *nBatchFiles, char ***batchFiles, char *manifest,
+                  char *ckptFile, int *shardSize, char *statsFile,
+                  char *kernelName, BOOL *selfTest)
 {
    argc--;
    argv++;
 
-   infile[0]   = outfile[0] = '\0';
-   *verbosity  = 0;
-   *reportOnly = FALSE;
+   infile[0]    = outfile[0] = batchDir[0] = '\0';
+   manifest[0]  = ckptFile[0] = statsFile[0] = kernelName[0] = '\0';
+   *verbosity   = 0;
+   *reportOnly  = FALSE;
+   *nBatchFiles = 0;
+   *batchFiles  = NULL;
+   *shardSize   = DEFSHARDSIZE;
+   *selfTest    = FALSE;
    
    while(argc)
    {
@@ -185,11 +1351,69 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
          case 'r':
             *reportOnly = TRUE;
             break;
+         case 'b':
+            argc--;
+            argv++;
+            if(!argc || (strlen(argv[0]) >= MAXBUFF))
+               return(FALSE);
+            strcpy(batchDir, argv[0]);
+            break;
+         case 'm':
+            argc--;
+            argv++;
+            if(!argc || (strlen(argv[0]) >= MAXBUFF))
+               return(FALSE);
+            strcpy(manifest, argv[0]);
+            break;
+         case 'c':
+            argc--;
+            argv++;
+            if(!argc || (strlen(argv[0]) >= MAXBUFF))
+               return(FALSE);
+            strcpy(ckptFile, argv[0]);
+            break;
+         case 'a':
+            argc--;
+            argv++;
+            if(!argc || (strlen(argv[0]) >= MAXBUFF))
+               return(FALSE);
+            strcpy(statsFile, argv[0]);
+            break;
+         case '-':
+            if(!strncmp(argv[0], "--kernel=", 9) &&
+               (strlen(argv[0]+9) < MAXBUFF))
+               strcpy(kernelName, argv[0]+9);
+            else if(!strcmp(argv[0], "--selftest"))
+               *selfTest = TRUE;
+            else
+               return(FALSE);
+            break;
+         case 's':
+            argc--;
+            argv++;
+            if(!argc || !sscanf(argv[0], "%d", shardSize) ||
+               (*shardSize < 1))
+               return(FALSE);
+            break;
          default:
             return(FALSE);
             break;
          }
       }
+      else if(manifest[0])
+      {
+         /* Job mode takes its input files from the manifest            */
+         return(FALSE);
+      }
+      else if(batchDir[0] || statsFile[0] || *selfTest)
+      {
+         /* In batch, aggregate and self-test modes all remaining 
+            arguments are input files
+         */
+         *nBatchFiles = argc;
+         *batchFiles  = argv;
+         return(TRUE);
+      }
       else
       {
          /* Check that there are only 1 or 2 arguments left             */
@@ -211,6 +1435,22 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
       argv++;
    }
    
+   /* Job mode defaults to a checkpoint log named after the manifest   */
+   if(manifest[0] && !statsFile[0] && !*selfTest)
+   {
+      if(!ckptFile[0])
+      {
+         if(strlen(manifest) + 5 >= MAXBUFF)
+            return(FALSE);
+         sprintf(ckptFile, "%s.ckpt", manifest);
+      }
+      return(TRUE);
+   }
+   
+   /* Batch, aggregate and self-test modes need at least one input file*/
+   if((batchDir[0] || statsFile[0] || *selfTest) && !manifest[0])
+      return(FALSE);
+   
    return(TRUE);
 }
 
@@ -227,16 +1467,78 @@ BOOL ParseCmdLine(int argc, char **argv, char *infile, char *outfile,
 -  06.11.14 V1.2 By: ACRM
 -  12.03.15 V1.5
 -  13.03.23 V2.0
+-  18.10.26 V2.1   By: agent
+-  18.10.26 V2.2   By: agent
+-  18.10.26 V2.3   By: agent
+-  18.10.26 V2.4   By: agent
+-  18.10.26 V2.5   By: agent
+-  18.10.26 V2.6   By: agent
+-  18.10.26 V2.7   By: agent
+-  18.10.26 Explains residues which cannot be swapped   By: agent
 */
 void Usage(void)
 {
-   fprintf(stderr,"\npdbflip V2.0 (c) 2014-2023 Prof. Andrew C.R. \
+   fprintf(stderr,"\npdbflip V2.7 (c) 2014-2026 Prof. Andrew C.R. \
 Martin, UCL\n");
    fprintf(stderr,"\nUsage: pdbflip [-v[v]] [-r] [in.pdb [out.pdb]]\n");
+   fprintf(stderr,"       pdbflip [-v[v]] [-r] -b outdir in.pdb \
+[in.pdb ...]\n");
+   fprintf(stderr,"       pdbflip [-v[v]] [-r] [-b outdir] [-c ckpt] \
+[-s n] -m manifest\n");
+   fprintf(stderr,"       pdbflip [-v] -a stats.json {-m manifest | \
+in.pdb [in.pdb ...]}\n");
+   fprintf(stderr,"       pdbflip --selftest {-m manifest | in.pdb \
+[in.pdb ...]}\n");
    fprintf(stderr,"               -v   Report fixed atoms\n");
    fprintf(stderr,"               -vv  Report unfixed atoms as well\n");
    fprintf(stderr,"               -r   Only report atoms rather than \
 fixing\n");
+   fprintf(stderr,"               -b   Batch mode. Process all the input \
+files, writing\n");
+   fprintf(stderr,"                    each to a file of the same name \
+in outdir\n");
+   fprintf(stderr,"               -m   Job mode. Process the files listed \
+in the manifest\n");
+   fprintf(stderr,"                    (one input file per line, \
+optionally followed by\n");
+   fprintf(stderr,"                    an output file, otherwise written \
+to outdir).\n");
+   fprintf(stderr,"                    Completed files are recorded in \
+a checkpoint log\n");
+   fprintf(stderr,"                    and skipped when the job is \
+restarted. Several\n");
+   fprintf(stderr,"                    processes may share a manifest and \
+checkpoint log.\n");
+   fprintf(stderr,"                    Entries which would write the same \
+output file as\n");
+   fprintf(stderr,"                    an earlier entry fail\n");
+   fprintf(stderr,"               -c   Specify the checkpoint log \
+(Default: manifest.ckpt).\n");
+   fprintf(stderr,"                    Shards are locked in ckpt.lock \
+which may be deleted\n");
+   fprintf(stderr,"                    once no process is running the \
+job\n");
+   fprintf(stderr,"               -s   Specify the number of manifest \
+entries that a\n");
+   fprintf(stderr,"                    process claims at a time \
+(Default: %d)\n", DEFSHARDSIZE);
+   fprintf(stderr,"               -a   Aggregate mode. Write a JSON \
+summary of the torsions\n");
+   fprintf(stderr,"                    (as reported by -r) over all the \
+input files to\n");
+   fprintf(stderr,"                    stats.json. Input files may be \
+listed in a manifest\n");
+   fprintf(stderr,"                    in which case no checkpoint log \
+is used\n");
+   fprintf(stderr,"               --kernel=name Use the named geometry \
+kernel (avx512,\n");
+   fprintf(stderr,"                    avx2 or generic) rather than the \
+best one for this\n");
+   fprintf(stderr,"                    CPU\n");
+   fprintf(stderr,"               --selftest Check that all the geometry \
+kernels this CPU\n");
+   fprintf(stderr,"                    supports make the same decisions \
+on the input files\n");
 
    fprintf(stderr,"\npdbflip V2 is a much-improved program for fixing \
 the names of\n");
@@ -248,6 +1550,14 @@ simpler. It \n");
    printf("still assumes that the connectivity is correct (e.g. in PHE, \
 CE1 is\n");
    printf("connected to CD1 and CE2 is connected to CD2).\n");
+   printf("Any hydrogens on the symmetrical atoms (e.g. HD11-HD23 in LEU, \
+HH11-HH22\n");
+   printf("in ARG) are swapped along with them. A residue with a \
+hydrogen on only one\n");
+   printf("of a pair of atoms (e.g. ASP or GLU with one proton) is \
+not swapped, since\n");
+   printf("the hydrogen would be left with the wrong name; -r \
+reports it as CANNOT SWAP.\n");
    printf("\nLEU and VAL were not handled by the old version.\n\n");
 }
 